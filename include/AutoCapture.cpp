@@ -0,0 +1,292 @@
+#include "AutoCapture.h"
+
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+static float length(cv::Point2f v)
+{
+	return sqrt(v.x * v.x + v.y * v.y);
+}
+
+// Constructors
+// calib: Calibrator detecting boards, its board size and flag are used
+// maxBlur: largest estimated edge blur of an accepted board in pixels, about 0.7 when sharp
+// maxMotion: largest mean corner motion per frame of an accepted board in pixels,
+//            a moving board is smeared by the exposure even if edges look sharp
+// minNovelty: smallest pose distance to accepted views, unless the view covers new cells
+// minNewCells: new coverage cells making a view worth it whatever its pose is
+AutoCapture::AutoCapture(Calibrator& calib, double maxBlur, float maxMotion,
+		double minNovelty, int minNewCells) : calib(calib)
+{
+	board_sz = calib.getBoardSize();
+	this->maxBlur = maxBlur;
+	this->maxMotion = maxMotion;
+	this->minNovelty = minNovelty;
+	this->minNewCells = minNewCells;
+	running = false;
+	hasPending = false;
+	nScored = 0;
+	nDropped = 0;
+	lastSequence = -1;
+}
+
+// class destructor
+AutoCapture::~AutoCapture()
+{
+	stop();
+}
+
+// methods
+// start the worker, it's also started by the first push()
+void AutoCapture::start()
+{
+	lock_guard<mutex> lock(mtx);
+	if(running)
+		return;
+	running = true;
+	worker = thread(&AutoCapture::run, this);
+}
+
+// stop the worker, a frame not scored yet is dropped
+void AutoCapture::stop()
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		if(!running)
+			return;
+		running = false;
+		if(hasPending)
+			nDropped++;
+		hasPending = false;
+		pending = CaptureFrame();
+	}
+	cond.notify_one();
+	worker.join();
+}
+
+// hand a live frame to the worker without waiting for it
+// frames are copied, so the caller may reuse its buffers at once
+// sequence: index of the frame in the live stream, it measures the motion between frames
+// frame1: gray frame of one camera or camera1 of DCM
+// frame2: gray frame of camera2 of DCM, default value is cv::Mat() with one camera
+void AutoCapture::push(int sequence, cv::Mat frame1, cv::Mat frame2)
+{
+	if(frame1.empty())
+		return;
+	start();
+
+	CaptureFrame frame;
+	frame.sequence = sequence;
+	frame.frame1 = frame1.clone();
+	if(!frame2.empty())
+		frame.frame2 = frame2.clone();
+	{
+		lock_guard<mutex> lock(mtx);
+		if(hasPending)
+			nDropped++;
+		pending = frame;
+		hasPending = true;
+	}
+	cond.notify_one();
+}
+
+// take the oldest accepted view not taken yet
+// return false if there isn't any
+bool AutoCapture::pop(CapturedView& view)
+{
+	lock_guard<mutex> lock(mtx);
+	if(accepted.empty())
+		return false;
+	view = accepted.front();
+	accepted.pop_front();
+	return true;
+}
+
+int AutoCapture::getnScored()
+{
+	lock_guard<mutex> lock(mtx);
+	return nScored;
+}
+
+int AutoCapture::getnDropped()
+{
+	lock_guard<mutex> lock(mtx);
+	return nDropped;
+}
+
+// loop of the worker, it scores the latest frame until it's stopped
+void AutoCapture::run()
+{
+	while(true)
+	{
+		CaptureFrame frame;
+		{
+			unique_lock<mutex> lock(mtx);
+			cond.wait(lock, [this]() { return hasPending || !running; });
+			if(!running)
+				break;
+			frame = pending;
+			pending = CaptureFrame();
+			hasPending = false;
+		}
+
+		CapturedView view;
+		bool isAccepted = score(frame, view);
+
+		lock_guard<mutex> lock(mtx);
+		nScored++;
+		if(isAccepted)
+			accepted.push_back(view);
+	}
+}
+
+// score one frame, and remember it as covered if it's accepted
+// frame: frame to score
+// view: the frame with its corners and scores if it's accepted
+// return true if every camera sees a sharp and still board, and its pose or coverage is new
+bool AutoCapture::score(CaptureFrame& frame, CapturedView& view)
+{
+	bool isDCM = !frame.frame2.empty();
+	if(!calib.findBoard(frame.frame1, view.corners1) ||
+			(isDCM && !calib.findBoard(frame.frame2, view.corners2)))
+	{
+		lastSequence = -1;
+		return false;
+	}
+
+	// corners moving fast between frames are smeared within the exposure
+	int gap = frame.sequence - lastSequence;
+	bool still = lastSequence >= 0 && gap > 0 && lastCorners.size() == view.corners1.size();
+	if(still)
+	{
+		float motion = 0;
+		for(size_t j = 0; j < lastCorners.size(); j++)
+			motion += length(view.corners1[j] - lastCorners[j]);
+		still = motion / lastCorners.size() <= maxMotion * gap;
+	}
+	lastCorners = view.corners1;
+	lastSequence = frame.sequence;
+	if(!still)
+		return false;
+
+	view.blur = edgeBlur(frame.frame1, view.corners1);
+	if(isDCM)
+		view.blur = max(view.blur, edgeBlur(frame.frame2, view.corners2));
+	if(view.blur > maxBlur)
+		return false;
+
+	// pose distance to the nearest accepted view, and cells reached first by this view
+	cv::Size imageSize = frame.frame1.size();
+	if(covered.getnViews() == 0)
+	{
+		covered.reset(imageSize, board_sz);
+		poses.clear();
+	}
+	vector<double> pose = covered.poseOf(view.corners1);
+	view.novelty = poses.empty() ? 1e9 : -1;
+	for(size_t i = 0; i < poses.size(); i++)
+	{
+		double d2 = 0;
+		for(size_t k = 0; k < pose.size(); k++)
+			d2 += (pose[k] - poses[i][k]) * (pose[k] - poses[i][k]);
+		if(view.novelty < 0 || sqrt(d2) < view.novelty)
+			view.novelty = sqrt(d2);
+	}
+	view.newCells = covered.countNewCells(view.corners1, view.corners2);
+	if(view.novelty < minNovelty && view.newCells < minNewCells)
+		return false;
+
+	poses.push_back(pose);
+	covered.addView(view.corners1, view.corners2);
+	view.frame1 = frame.frame1;
+	view.frame2 = frame.frame2;
+	return true;
+}
+
+// estimate the blur of board edges in pixels, as the sigma of a Gaussian edge profile
+// whose peak gradient is the contrast of the board over sqrt(2 pi) sigma
+// the peak is the mean of the strongest gradients, as many as pixels on edge centers,
+// so it doesn't depend on the size of squares or on the contrast
+// gray: gray frame
+// corners: inner corners of the board on gray
+double AutoCapture::edgeBlur(const cv::Mat& gray, const vector<cv::Point2f>& corners) const
+{
+	int W = board_sz.width, H = board_sz.height;
+	if((int)corners.size() != W * H || W < 2 || H < 2)
+		return 0;
+
+	float xMin = corners[0].x, xMax = corners[0].x, yMin = corners[0].y, yMax = corners[0].y;
+	float side = 0;
+	for(int r = 0; r < H; r++)
+	{
+		for(int c = 0; c < W; c++)
+		{
+			const cv::Point2f& p = corners[r * W + c];
+			xMin = min(xMin, p.x);
+			xMax = max(xMax, p.x);
+			yMin = min(yMin, p.y);
+			yMax = max(yMax, p.y);
+			if(c + 1 < W)
+				side += length(corners[r * W + c + 1] - p);
+		}
+	}
+	side /= H * (W - 1);
+
+	int x0 = max((int)xMin, 1), x1 = min((int)xMax, gray.cols - 2);
+	int y0 = max((int)yMin, 1), y1 = min((int)yMax, gray.rows - 2);
+	if(x0 >= x1 || y0 >= y1 || side < 1)
+		return 0;
+
+	vector<float> gradients;
+	gradients.reserve((size_t)(x1 - x0 + 1) * (y1 - y0 + 1));
+	int histogram[256] = {0};
+	for(int y = y0; y <= y1; y++)
+	{
+		const uchar* up = gray.ptr<uchar>(y - 1);
+		const uchar* center = gray.ptr<uchar>(y);
+		const uchar* down = gray.ptr<uchar>(y + 1);
+		for(int x = x0; x <= x1; x++)
+		{
+			float gx = 0.5f * ((float)center[x + 1] - (float)center[x - 1]);
+			float gy = 0.5f * ((float)down[x] - (float)up[x]);
+			gradients.push_back(sqrt(gx * gx + gy * gy));
+			histogram[center[x]]++;
+		}
+	}
+
+	// contrast between the 10% darkest and the 10% brightest pixels
+	int total = (int)gradients.size();
+	int dark = 0, bright = 255, count = 0;
+	for(int v = 0; v < 256; v++)
+	{
+		count += histogram[v];
+		if(count >= total / 10)
+		{
+			dark = v;
+			break;
+		}
+	}
+	count = 0;
+	for(int v = 255; v >= 0; v--)
+	{
+		count += histogram[v];
+		if(count >= total / 10)
+		{
+			bright = v;
+			break;
+		}
+	}
+
+	// edges of squares of side s take about 2 / s of the pixels, one pixel wide,
+	// and the stronger half of them is close to edge centers
+	size_t nPeak = max((size_t)1, (size_t)(total / side));
+	nth_element(gradients.begin(), gradients.begin() + (nPeak - 1), gradients.end(), greater<float>());
+	double peak = 0;
+	for(size_t k = 0; k < nPeak; k++)
+		peak += gradients[k];
+	peak /= nPeak;
+	if(peak <= 0)
+		return 1e9;
+	return (bright - dark) / (sqrt(2 * CV_PI) * peak);
+}
@@ -0,0 +1,85 @@
+#ifndef AUTO_CAPTURE_H_
+#define AUTO_CAPTURE_H_
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+#include "Calibrator.h"
+#include "CoverageMap.h"
+
+using namespace std;
+
+// a live frame waiting to be scored
+struct CaptureFrame
+{
+	int sequence;                  // index of the frame in the live stream
+	cv::Mat frame1;                // gray frame of one camera or camera1 of DCM
+	cv::Mat frame2;                // gray frame of camera2 of DCM, empty otherwise
+	CaptureFrame() : sequence(0) {}
+};
+
+// a frame accepted by AutoCapture, with its corners and scores
+struct CapturedView
+{
+	cv::Mat frame1;                // gray frame of one camera or camera1 of DCM
+	cv::Mat frame2;                // gray frame of camera2 of DCM, empty otherwise
+	vector<cv::Point2f> corners1;  // inner corners on frame1
+	vector<cv::Point2f> corners2;  // inner corners on frame2
+	double blur;                   // estimated edge blur of the board in pixels
+	double novelty;                // pose distance to the nearest view accepted before
+	int newCells;                  // coverage cells first reached by this view
+	CapturedView() : blur(0), novelty(0), newCells(0) {}
+};
+
+// AutoCapture decides on its own thread which live frames are worth calibrating with.
+// Every frame is scored by whether the whole board is found, how sharp the board is,
+// how far its pose is from views accepted before, and how many uncovered cells of
+// the image its corners reach, and only frames adding information are accepted.
+// Like Viewer, it keeps only the latest frame not scored yet, so push() never waits.
+class AutoCapture
+{
+	private:
+		Calibrator& calib;        // detects boards, it isn't changed by the worker
+		cv::Size board_sz;        // size of inner corners
+		double maxBlur;           // largest estimated edge blur of an accepted board in pixels
+		float maxMotion;          // largest corner motion per frame of an accepted board in pixels
+		double minNovelty;        // smallest pose distance to accepted views if no cell is new
+		int minNewCells;          // new coverage cells making a view worth it regardless of pose
+
+		thread worker;            // thread scoring frames
+		mutex mtx;                // guards pending, hasPending, accepted, running and counters
+		condition_variable cond;  // wakes the worker up when a frame comes
+		bool running;             // whether the worker is running
+		bool hasPending;          // whether pending holds a frame not scored yet
+		CaptureFrame pending;     // latest frame not scored yet
+		deque<CapturedView> accepted;  // accepted views not taken by pop() yet
+		int nScored;              // frames scored
+		int nDropped;             // frames replaced before being scored
+
+		// state of the worker only
+		vector<vector<double> > poses;  // pose descriptors of accepted views
+		CoverageMap covered;      // coverage of accepted views
+		vector<cv::Point2f> lastCorners; // corners of camera1 on the last scored frame
+		int lastSequence;         // sequence of the last scored frame, -1 if none
+
+		void run();
+		bool score(CaptureFrame& frame, CapturedView& view);
+		double edgeBlur(const cv::Mat& gray, const vector<cv::Point2f>& corners) const;
+
+	public:
+		AutoCapture(Calibrator& calib, double maxBlur = 1.5, float maxMotion = 2.f,
+				double minNovelty = 0.15, int minNewCells = 2);
+		~AutoCapture();
+		void start();
+		void stop();
+		void push(int sequence, cv::Mat frame1, cv::Mat frame2 = cv::Mat());
+		bool pop(CapturedView& view);
+		int getnScored();
+		int getnDropped();
+};
+
+#endif
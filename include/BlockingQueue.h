@@ -0,0 +1,77 @@
+#ifndef BLOCKING_QUEUE_H_
+#define BLOCKING_QUEUE_H_
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// BlockingQueue is a bounded FIFO queue shared by threads.
+// push() waits while the queue is full and pop() waits while it's empty,
+// so memory held by the queue never exceeds capacity items.
+template<typename T>
+class BlockingQueue
+{
+	private:
+		deque<T> items;                 // queued items, the oldest at front
+		size_t capacity;                // maximum number of queued items
+		bool closed;                    // whether no more items will be pushed
+		mutex mtx;                      // guards items and closed
+		condition_variable notFull;     // signaled when an item is popped
+		condition_variable notEmpty;    // signaled when an item is pushed
+
+	public:
+		BlockingQueue(size_t capacity = 1)
+		{
+			this->capacity = capacity > 0 ? capacity : 1;
+			closed = false;
+		}
+
+		// push item at back, wait if the queue is full
+		// return false if the queue is closed and item is discarded
+		bool push(const T& item)
+		{
+			unique_lock<mutex> lock(mtx);
+			while(!closed && items.size() >= capacity)
+				notFull.wait(lock);
+			if(closed)
+				return false;
+			items.push_back(item);
+			notEmpty.notify_one();
+			return true;
+		}
+
+		// pop item at front, wait if the queue is empty
+		// return false if the queue is closed and all items are popped
+		bool pop(T& item)
+		{
+			unique_lock<mutex> lock(mtx);
+			while(!closed && items.empty())
+				notEmpty.wait(lock);
+			if(items.empty())
+				return false;
+			item = items.front();
+			items.pop_front();
+			notFull.notify_one();
+			return true;
+		}
+
+		// refuse further items and wake up all waiting threads,
+		// items already queued can still be popped
+		void close()
+		{
+			lock_guard<mutex> lock(mtx);
+			closed = true;
+			notFull.notify_all();
+			notEmpty.notify_all();
+		}
+
+		size_t size()
+		{
+			lock_guard<mutex> lock(mtx);
+			return items.size();
+		}
+};
+
+#endif
@@ -0,0 +1,1069 @@
+#include "BundleAdjuster.h"
+
+#include <cmath>
+#include <thread>
+#include <iostream>
+#include <algorithm>
+#include <opencv2/calib3d/calib3d.hpp>
+
+// largest block of shared parameters solved by the Schur complement
+static const int MAX_GLOBAL = 24;
+
+// number of intrinsics of one camera, fx, fy, k1, k2, p1, p2, k3
+static const int N_INTRINSICS = 7;
+
+// Cholesky decomposition A = L * L^T of a symmetric n x n matrix
+// return false if A isn't positive definite
+static bool cholesky(const double* A, int n, double* L)
+{
+	for(int i = 0; i < n; i++)
+	{
+		for(int j = 0; j <= i; j++)
+		{
+			double s = A[i * n + j];
+			for(int k = 0; k < j; k++)
+				s -= L[i * n + k] * L[j * n + k];
+			if(i == j)
+			{
+				if(!(s > 0))
+					return false;
+				L[i * n + i] = sqrt(s);
+			}
+			else
+				L[i * n + j] = s / L[j * n + j];
+		}
+	}
+	return true;
+}
+
+// solve L * L^T * x = b in place, L from cholesky()
+static void choleskySolve(const double* L, int n, double* b)
+{
+	for(int i = 0; i < n; i++)
+	{
+		double s = b[i];
+		for(int k = 0; k < i; k++)
+			s -= L[i * n + k] * b[k];
+		b[i] = s / L[i * n + i];
+	}
+	for(int i = n - 1; i >= 0; i--)
+	{
+		double s = b[i];
+		for(int k = i + 1; k < n; k++)
+			s -= L[k * n + i] * b[k];
+		b[i] = s / L[i * n + i];
+	}
+}
+
+// inverse of a symmetric positive definite n x n matrix, n <= MAX_GLOBAL
+// return false if A isn't positive definite
+static bool choleskyInvert(const double* A, int n, double* inverse)
+{
+	double L[MAX_GLOBAL * MAX_GLOBAL];
+	double column[MAX_GLOBAL];
+	if(!cholesky(A, n, L))
+		return false;
+	for(int j = 0; j < n; j++)
+	{
+		for(int i = 0; i < n; i++)
+			column[i] = i == j ? 1 : 0;
+		choleskySolve(L, n, column);
+		for(int i = 0; i < n; i++)
+			inverse[i * n + j] = column[i];
+	}
+	return true;
+}
+
+// rotation matrix of a rotation vector
+static cv::Matx33d rotationOf(const cv::Vec3d& r)
+{
+	cv::Mat rvec(3, 1, CV_64F), Rm;
+	for(int i = 0; i < 3; i++)
+		rvec.at<double>(i) = r[i];
+	cv::Rodrigues(rvec, Rm);
+	cv::Matx33d R;
+	for(int i = 0; i < 9; i++)
+		R.val[i] = Rm.at<double>(i / 3, i % 3);
+	return R;
+}
+
+// rotation vector of a rotation matrix
+static cv::Vec3d rotationVectorOf(const cv::Matx33d& R)
+{
+	cv::Mat Rm(3, 3, CV_64F), rvec;
+	for(int i = 0; i < 9; i++)
+		Rm.at<double>(i / 3, i % 3) = R.val[i];
+	cv::Rodrigues(Rm, rvec);
+	return cv::Vec3d(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2));
+}
+
+// camera matrix and distortion coefficients of intrinsics fx, fy, k1, k2, p1, p2, k3
+static void toCameraParas(const double* intrinsics, double cx, double cy,
+		cv::Mat& cameraMatrix, cv::Mat& distCoeffs)
+{
+	cameraMatrix = cv::Mat::eye(3, 3, CV_64F);
+	cameraMatrix.at<double>(0, 0) = intrinsics[0];
+	cameraMatrix.at<double>(1, 1) = intrinsics[1];
+	cameraMatrix.at<double>(0, 2) = cx;
+	cameraMatrix.at<double>(1, 2) = cy;
+	distCoeffs = cv::Mat(1, 5, CV_64F);
+	for(int k = 0; k < 5; k++)
+		distCoeffs.at<double>(k) = intrinsics[2 + k];
+}
+
+// standard deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3 in a 9 x 1 matrix,
+// those of cx and cy are 0 since the principal point is fixed
+// covariance: covariance of fx, fy, k1, k2, p1, p2, k3 on the diagonal, rows stride apart
+// sigma2: variance of a residual, (J^T J)^-1 is scaled by it
+// return an empty matrix if the covariance isn't known, that is a diagonal isn't positive as
+// optimize() leaves it for singular normal equations, or sigma2 isn't, without redundant
+// residuals, so poorly determined intrinsics never look certain
+static cv::Mat toStdDevs(const double* covariance, int stride, double sigma2)
+{
+	if(!(sigma2 > 0))
+		return cv::Mat();
+	cv::Mat stdDevs = cv::Mat::zeros(9, 1, CV_64F);
+	int layout[N_INTRINSICS] = {0, 1, 4, 5, 6, 7, 8};
+	for(int k = 0; k < N_INTRINSICS; k++)
+	{
+		double variance = covariance[k * stride + k];
+		if(!(variance > 0) || std::isinf(variance))
+			return cv::Mat();
+		stdDevs.at<double>(layout[k]) = sqrt(variance * sigma2);
+	}
+	return stdDevs;
+}
+
+// project a point in camera coordinates into pixels, with derivatives
+// intrinsics: fx, fy, k1, k2, p1, p2, k3
+// cx, cy: principal point
+// Xc: the point in camera coordinates
+// uv: projected pixel
+// Ji: 2 rows of derivatives by intrinsics, stride apart, NULL to skip
+// Jc: 2 x 3 derivatives by Xc, NULL to skip
+static void project(const double* intrinsics, double cx, double cy, const double* Xc,
+		double* uv, double* Ji, int stride, double* Jc)
+{
+	double fx = intrinsics[0], fy = intrinsics[1];
+	double k1 = intrinsics[2], k2 = intrinsics[3];
+	double p1 = intrinsics[4], p2 = intrinsics[5], k3 = intrinsics[6];
+	double z = 1 / Xc[2];
+	double x = Xc[0] * z, y = Xc[1] * z;
+	double r2 = x * x + y * y, r4 = r2 * r2, r6 = r4 * r2;
+	double radial = 1 + k1 * r2 + k2 * r4 + k3 * r6;
+	double xd = x * radial + 2 * p1 * x * y + p2 * (r2 + 2 * x * x);
+	double yd = y * radial + p1 * (r2 + 2 * y * y) + 2 * p2 * x * y;
+	uv[0] = fx * xd + cx;
+	uv[1] = fy * yd + cy;
+
+	if(Ji)
+	{
+		double* ju = Ji;
+		double* jv = Ji + stride;
+		ju[0] = xd;                    jv[0] = 0;
+		ju[1] = 0;                     jv[1] = yd;
+		ju[2] = fx * x * r2;           jv[2] = fy * y * r2;
+		ju[3] = fx * x * r4;           jv[3] = fy * y * r4;
+		ju[4] = fx * 2 * x * y;        jv[4] = fy * (r2 + 2 * y * y);
+		ju[5] = fx * (r2 + 2 * x * x); jv[5] = fy * 2 * x * y;
+		ju[6] = fx * x * r6;           jv[6] = fy * y * r6;
+	}
+
+	if(Jc)
+	{
+		// derivatives of distorted coordinates by normalized ones, then by Xc
+		double dRadial = k1 + 2 * k2 * r2 + 3 * k3 * r4;
+		double dxdx = radial + 2 * x * x * dRadial + 2 * p1 * y + 6 * p2 * x;
+		double dxdy = 2 * x * y * dRadial + 2 * p1 * x + 2 * p2 * y;
+		double dydx = dxdy;
+		double dydy = radial + 2 * y * y * dRadial + 6 * p1 * y + 2 * p2 * x;
+		Jc[0] = fx * dxdx * z;
+		Jc[1] = fx * dxdy * z;
+		Jc[2] = -fx * (dxdx * x + dxdy * y) * z;
+		Jc[3] = fy * dydx * z;
+		Jc[4] = fy * dydy * z;
+		Jc[5] = -fy * (dydx * x + dydy * y) * z;
+	}
+}
+
+// derivatives of projected pixels by the pose, 2 rows of 6 in Jp
+// Jc: derivatives by the point in camera coordinates from project()
+// P: the point rotated into camera coordinates, before translation
+// a rotation increment w turns R into Rodrigues(w) * R, so Xc changes by w x P
+static void poseDerivatives(const double* Jc, const double* P, double* Jp)
+{
+	for(int row = 0; row < 2; row++)
+	{
+		const double* j = Jc + row * 3;
+		double* out = Jp + row * 6;
+		out[0] = j[1] * -P[2] + j[2] * P[1];
+		out[1] = j[0] * P[2] + j[2] * -P[0];
+		out[2] = j[0] * -P[1] + j[1] * P[0];
+		out[3] = j[0];
+		out[4] = j[1];
+		out[5] = j[2];
+	}
+}
+
+// residuals of one view in one camera and their derivatives, as ViewResiduals of one camera
+// objects, corners: board model and detected corners of the view
+// intrinsics: fx, fy, k1, k2, p1, p2, k3, cx, cy: principal point
+// Jg: derivatives by intrinsics, N_INTRINSICS per row, NULL to skip
+// Jp: derivatives by the pose, 6 per row, NULL to skip
+static void viewResiduals(const vector<cv::Point3f>& objects, const vector<cv::Point2f>& corners,
+		const double* intrinsics, double cx, double cy, const cv::Matx33d& R, const cv::Vec3d& t,
+		double* residuals, double* Jg, double* Jp)
+{
+	for(size_t j = 0; j < corners.size(); j++)
+	{
+		double X[3] = {objects[j].x, objects[j].y, objects[j].z};
+		double P[3], Xc[3], uv[2], Jc[6];
+		for(int i = 0; i < 3; i++)
+		{
+			P[i] = R.val[i * 3] * X[0] + R.val[i * 3 + 1] * X[1] + R.val[i * 3 + 2] * X[2];
+			Xc[i] = P[i] + t[i];
+		}
+		project(intrinsics, cx, cy, Xc, uv, Jg ? Jg + j * 2 * N_INTRINSICS : NULL,
+				N_INTRINSICS, Jp ? Jc : NULL);
+		residuals[j * 2] = uv[0] - corners[j].x;
+		residuals[j * 2 + 1] = uv[1] - corners[j].y;
+		if(Jp)
+			poseDerivatives(Jc, P, Jp + j * 12);
+	}
+}
+
+// refine the pose of one view with fixed intrinsics by Gauss-Newton on viewResiduals(),
+// a few iterations from the pose of solvePnP() are enough, since only 6 parameters move
+// return the sum of squared residuals at the refined pose
+static double refinePose(const vector<cv::Point3f>& objects, const vector<cv::Point2f>& corners,
+		const double* intrinsics, double cx, double cy, cv::Matx33d& R, cv::Vec3d& t)
+{
+	int n = 2 * (int)corners.size();
+	vector<double> r(n), Jp(n * 6);
+	double cost = 0;
+	for(int iteration = 0; iteration < 10; iteration++)
+	{
+		viewResiduals(objects, corners, intrinsics, cx, cy, R, t, &r[0], NULL, &Jp[0]);
+		double A[36] = {0}, L[36], b[6] = {0};
+		cost = 0;
+		for(int k = 0; k < n; k++)
+		{
+			const double* jp = &Jp[k * 6];
+			cost += r[k] * r[k];
+			for(int c = 0; c < 6; c++)
+			{
+				b[c] -= jp[c] * r[k];
+				for(int d = 0; d < 6; d++)
+					A[c * 6 + d] += jp[c] * jp[d];
+			}
+		}
+		if(!cholesky(A, 6, L))
+			break;
+		choleskySolve(L, 6, b);
+		cv::Matx33d trialR = rotationOf(cv::Vec3d(b[0], b[1], b[2])) * R;
+		cv::Vec3d trialT(t[0] + b[3], t[1] + b[4], t[2] + b[5]);
+		viewResiduals(objects, corners, intrinsics, cx, cy, trialR, trialT, &r[0], NULL, NULL);
+		double trialCost = 0;
+		for(int k = 0; k < n; k++)
+			trialCost += r[k] * r[k];
+		if(trialCost >= cost)
+			break;
+		R = trialR;
+		t = trialT;
+		bool converged = cost - trialCost <= 1e-12 * cost;
+		cost = trialCost;
+		if(converged)
+			break;
+	}
+	return cost;
+}
+
+// intrinsics fx, fy, k1, k2, p1, p2, k3 and the principal point of a camera matrix and
+// distortion coefficients, missing coefficients are 0
+static void fromCameraParas(const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs,
+		double* intrinsics, double& cx, double& cy)
+{
+	cv::Mat M, D;
+	cameraMatrix.convertTo(M, CV_64F);
+	intrinsics[0] = M.at<double>(0, 0);
+	intrinsics[1] = M.at<double>(1, 1);
+	cx = M.at<double>(0, 2);
+	cy = M.at<double>(1, 2);
+	for(int k = 0; k < 5; k++)
+		intrinsics[2 + k] = 0;
+	if(distCoeffs.empty())
+		return;
+	distCoeffs.convertTo(D, CV_64F);
+	for(int k = 0; k < 5 && k < (int)D.total(); k++)
+		intrinsics[2 + k] = D.at<double>(k);
+}
+
+// Constructor
+// nThreads: threads evaluating Jacobians, 0 means all cores
+// maxIterations: most iterations of Levenberg-Marquardt
+// epsilon: iterations stop once the cost decreases relatively less than epsilon
+BundleAdjuster::BundleAdjuster(int nThreads, int maxIterations, double epsilon)
+{
+	this->nThreads = nThreads;
+	this->maxIterations = maxIterations;
+	this->epsilon = epsilon;
+	nIterations = 0;
+}
+
+// number of threads sharing nViews views
+int BundleAdjuster::getnWorkers(int nViews)
+{
+	int workers = nThreads > 0 ? nThreads : (int)thread::hardware_concurrency();
+	return max(1, min(workers, nViews));
+}
+
+// run work(worker, begin, end) for views [begin, end) of every worker, each on its own thread
+void BundleAdjuster::forViews(int nViews, const function<void(int worker, int begin, int end)>& work)
+{
+	int workers = getnWorkers(nViews);
+	if(workers == 1)
+	{
+		work(0, 0, nViews);
+		return;
+	}
+	vector<thread> pool;
+	for(int w = 0; w < workers; w++)
+		pool.push_back(thread(work, w, nViews * w / workers, nViews * (w + 1) / workers));
+	for(size_t w = 0; w < pool.size(); w++)
+		pool[w].join();
+}
+
+// initial pose of every view by solvePnP() without distortion, as calibrateCamera() does
+// solved: whether the pose of every view is found
+// return the number of views whose poses are found
+int BundleAdjuster::initPoses(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints, const cv::Mat& cameraMatrix,
+		vector<cv::Matx33d>& R, vector<cv::Vec3d>& t, vector<char>& solved)
+{
+	int nViews = (int)objectPoints.size();
+	R.assign(nViews, cv::Matx33d());
+	t.assign(nViews, cv::Vec3d());
+	solved.assign(nViews, 0);
+	forViews(nViews, [&](int, int begin, int end)
+	{
+		for(int v = begin; v < end; v++)
+		{
+			cv::Mat rvec, tvec;
+			if(!cv::solvePnP(objectPoints[v], imagePoints[v], cameraMatrix, cv::noArray(), rvec, tvec))
+				continue;
+			rvec.convertTo(rvec, CV_64F);
+			tvec.convertTo(tvec, CV_64F);
+			R[v] = rotationOf(cv::Vec3d(rvec.at<double>(0), rvec.at<double>(1), rvec.at<double>(2)));
+			t[v] = cv::Vec3d(tvec.at<double>(0), tvec.at<double>(1), tvec.at<double>(2));
+			solved[v] = 1;
+		}
+	});
+	return (int)count(solved.begin(), solved.end(), 1);
+}
+
+// minimize the sum of squared residuals over global parameters and poses of all views
+// nGlobal: number of global parameters, at most MAX_GLOBAL
+// global: initial global parameters, the solution on return
+// nResiduals: number of residuals of every view
+// residualsOf: model filling residuals and Jacobians of one view
+// covariance: nGlobal x nGlobal inverse of J^T * J of global parameters at the solution,
+//             poses marginalized out, all 0 if J^T * J is singular there, NULL to skip
+// poses start from and end in rotations and translations
+// return the sum of squared residuals at the solution, or -1 if the normal equations are singular
+double BundleAdjuster::optimize(int nGlobal, vector<double>& global, const vector<int>& nResiduals,
+		const ViewResiduals& residualsOf, double* covariance)
+{
+	const int G = nGlobal;
+	int nViews = (int)nResiduals.size();
+	int workers = getnWorkers(nViews);
+	int maxResiduals = *max_element(nResiduals.begin(), nResiduals.end());
+	nIterations = 0;
+	if(G > MAX_GLOBAL)
+	{
+		cerr << "\033[0;32mERROR: Too many global parameters for BundleAdjuster: \033[0m" << G << endl;
+		return -1;
+	}
+
+	// normal equations, U = Jg^T Jg summed over views, V = Jp^T Jp and W = Jg^T Jp of every view,
+	// g and gv are gradients of global parameters and poses, partial sums are kept per worker
+	vector<double> U(G * G), g(G);
+	vector<double> V(nViews * 36), W(nViews * G * 6), gv(nViews * 6);
+	vector<double> partialU(workers * G * G), partialG(workers * G), partialCost(workers);
+	vector<double> buffers(workers * maxResiduals * (1 + G + 6));
+
+	// Jacobians and normal equations at the current parameters, return the cost
+	auto linearize = [&]() -> double
+	{
+		forViews(nViews, [&](int worker, int begin, int end)
+		{
+			double* r = &buffers[worker * maxResiduals * (1 + G + 6)];
+			double* Jg = r + maxResiduals;
+			double* Jp = Jg + maxResiduals * G;
+			double* u = &partialU[worker * G * G];
+			double* gg = &partialG[worker * G];
+			fill(u, u + G * G, 0.0);
+			fill(gg, gg + G, 0.0);
+			double cost = 0;
+			for(int v = begin; v < end; v++)
+			{
+				residualsOf(v, global.data(), rotations[v], translations[v], r, Jg, Jp);
+				double* vv = &V[v * 36];
+				double* w = &W[v * G * 6];
+				double* gp = &gv[v * 6];
+				fill(vv, vv + 36, 0.0);
+				fill(w, w + G * 6, 0.0);
+				fill(gp, gp + 6, 0.0);
+				for(int k = 0; k < nResiduals[v]; k++)
+				{
+					const double* jg = Jg + k * G;
+					const double* jp = Jp + k * 6;
+					cost += r[k] * r[k];
+					for(int i = 0; i < G; i++)
+					{
+						if(jg[i] == 0)
+							continue;
+						gg[i] += jg[i] * r[k];
+						for(int j = 0; j <= i; j++)
+							u[i * G + j] += jg[i] * jg[j];
+						for(int c = 0; c < 6; c++)
+							w[i * 6 + c] += jg[i] * jp[c];
+					}
+					for(int c = 0; c < 6; c++)
+					{
+						gp[c] += jp[c] * r[k];
+						for(int d = 0; d <= c; d++)
+							vv[c * 6 + d] += jp[c] * jp[d];
+					}
+				}
+				for(int c = 0; c < 6; c++)
+					for(int d = 0; d < c; d++)
+						vv[d * 6 + c] = vv[c * 6 + d];
+			}
+			partialCost[worker] = cost;
+		});
+
+		fill(U.begin(), U.end(), 0.0);
+		fill(g.begin(), g.end(), 0.0);
+		double cost = 0;
+		for(int worker = 0; worker < workers; worker++)
+		{
+			for(int i = 0; i < G * G; i++)
+				U[i] += partialU[worker * G * G + i];
+			for(int i = 0; i < G; i++)
+				g[i] += partialG[worker * G + i];
+			cost += partialCost[worker];
+		}
+		for(int i = 0; i < G; i++)
+			for(int j = 0; j < i; j++)
+				U[j * G + i] = U[i * G + j];
+		return cost;
+	};
+
+	// cost at trial parameters, residuals only
+	auto costAt = [&](const vector<double>& trial, const vector<cv::Matx33d>& R,
+			const vector<cv::Vec3d>& t) -> double
+	{
+		forViews(nViews, [&](int worker, int begin, int end)
+		{
+			double* r = &buffers[worker * maxResiduals * (1 + G + 6)];
+			double cost = 0;
+			for(int v = begin; v < end; v++)
+			{
+				residualsOf(v, trial.data(), R[v], t[v], r, NULL, NULL);
+				for(int k = 0; k < nResiduals[v]; k++)
+					cost += r[k] * r[k];
+			}
+			partialCost[worker] = cost;
+		});
+		double cost = 0;
+		for(int worker = 0; worker < workers; worker++)
+			cost += partialCost[worker];
+		return cost;
+	};
+
+	// Schur complement S = U' - sum W V'^-1 W^T and its right side b = -g + sum W V'^-1 gv,
+	// where U' and V' are damped by lambda, V'^-1 of every view is kept for back substitution
+	vector<double> Vinv(nViews * 36);
+	vector<double> partialS(workers * G * G), partialB(workers * G);
+	vector<char> singular(workers);
+	auto reduce = [&](double lambda, double* S, double* b) -> bool
+	{
+		forViews(nViews, [&](int worker, int begin, int end)
+		{
+			double* s = &partialS[worker * G * G];
+			double* bb = &partialB[worker * G];
+			fill(s, s + G * G, 0.0);
+			fill(bb, bb + G, 0.0);
+			singular[worker] = 0;
+			double damped[36], Y[MAX_GLOBAL * 6];
+			for(int v = begin; v < end; v++)
+			{
+				const double* w = &W[v * G * 6];
+				const double* gp = &gv[v * 6];
+				double* vi = &Vinv[v * 36];
+				copy(&V[v * 36], &V[v * 36] + 36, damped);
+				for(int c = 0; c < 6; c++)
+					damped[c * 7] += lambda * max(damped[c * 7], 1e-12);
+				if(!choleskyInvert(damped, 6, vi))
+				{
+					singular[worker] = 1;
+					return;
+				}
+				for(int i = 0; i < G; i++)
+				{
+					for(int c = 0; c < 6; c++)
+					{
+						double y = 0;
+						for(int d = 0; d < 6; d++)
+							y += w[i * 6 + d] * vi[d * 6 + c];
+						Y[i * 6 + c] = y;
+					}
+					for(int c = 0; c < 6; c++)
+						bb[i] += Y[i * 6 + c] * gp[c];
+					for(int j = 0; j <= i; j++)
+					{
+						double y = 0;
+						for(int c = 0; c < 6; c++)
+							y += Y[i * 6 + c] * w[j * 6 + c];
+						s[i * G + j] += y;
+					}
+				}
+			}
+		});
+		if(count(singular.begin(), singular.end(), 1) > 0)
+			return false;
+
+		for(int i = 0; i < G; i++)
+		{
+			b[i] = -g[i];
+			for(int j = 0; j <= i; j++)
+				S[i * G + j] = U[i * G + j];
+			S[i * G + i] += lambda * max(U[i * G + i], 1e-12);
+		}
+		for(int worker = 0; worker < workers; worker++)
+		{
+			for(int i = 0; i < G; i++)
+			{
+				b[i] += partialB[worker * G + i];
+				for(int j = 0; j <= i; j++)
+					S[i * G + j] -= partialS[worker * G * G + i * G + j];
+			}
+		}
+		for(int i = 0; i < G; i++)
+			for(int j = 0; j < i; j++)
+				S[j * G + i] = S[i * G + j];
+		return true;
+	};
+
+	double S[MAX_GLOBAL * MAX_GLOBAL], L[MAX_GLOBAL * MAX_GLOBAL], step[MAX_GLOBAL];
+	vector<double> trial(G);
+	vector<cv::Matx33d> trialRotations(nViews);
+	vector<cv::Vec3d> trialTranslations(nViews);
+	double cost = linearize();
+	double lambda = 1e-3;
+	while(nIterations < maxIterations && lambda < 1e16)
+	{
+		nIterations++;
+		if(!reduce(lambda, S, step) || !cholesky(S, G, L))
+		{
+			lambda *= 10;
+			continue;
+		}
+		choleskySolve(L, G, step);
+
+		// global step, then every pose by back substitution, dp = -V'^-1 (gv + W^T dg)
+		for(int i = 0; i < G; i++)
+			trial[i] = global[i] + step[i];
+		forViews(nViews, [&](int, int begin, int end)
+		{
+			for(int v = begin; v < end; v++)
+			{
+				const double* w = &W[v * G * 6];
+				const double* vi = &Vinv[v * 36];
+				double rhs[6], dp[6];
+				for(int c = 0; c < 6; c++)
+				{
+					rhs[c] = gv[v * 6 + c];
+					for(int i = 0; i < G; i++)
+						rhs[c] += w[i * 6 + c] * step[i];
+				}
+				for(int c = 0; c < 6; c++)
+				{
+					dp[c] = 0;
+					for(int d = 0; d < 6; d++)
+						dp[c] -= vi[c * 6 + d] * rhs[d];
+				}
+				trialRotations[v] = rotationOf(cv::Vec3d(dp[0], dp[1], dp[2])) * rotations[v];
+				trialTranslations[v] = cv::Vec3d(translations[v][0] + dp[3],
+						translations[v][1] + dp[4], translations[v][2] + dp[5]);
+			}
+		});
+
+		double trialCost = costAt(trial, trialRotations, trialTranslations);
+		if(trialCost < cost)
+		{
+			double decrease = cost - trialCost;
+			global = trial;
+			rotations.swap(trialRotations);
+			translations.swap(trialTranslations);
+			cost = linearize();
+			lambda = max(lambda / 10, 1e-12);
+			if(decrease <= epsilon * cost)
+				break;
+		}
+		else
+			lambda *= 10;
+	}
+
+	if(covariance)
+	{
+		if(!reduce(0, S, step) || !choleskyInvert(S, G, covariance))
+			fill(covariance, covariance + G * G, 0.0);
+	}
+	return cost;
+}
+
+// calibrate one camera with corners of all views
+// objectPoints: board model of every view, on the plane z = 0
+// imagePoints: detected corners of every view
+// imageSize: image size, the principal point starts at its center
+// cameraMatrix: calibrated intrinsic matrix
+// distCoeffs: calibrated k1, k2, p1, p2, k3 in a 1 x 5 matrix
+// stdDevs: standard deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3 in a 9 x 1 matrix,
+//          those of cx and cy are 0 since the principal point is fixed, empty if intrinsics
+//          aren't determined, e.g. by near frontal views
+// useGuess: start from cameraMatrix and distCoeffs instead of initCameraMatrix2D(),
+//           as a re-solve after dropping a few views does, the principal point stays
+// return the RMS reprojection error as calibrateCamera() does, or -1 on failure
+double BundleAdjuster::calibrate(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints, cv::Size imageSize,
+		cv::Mat& cameraMatrix, cv::Mat& distCoeffs, cv::Mat& stdDevs, bool useGuess)
+{
+	int nViews = (int)objectPoints.size();
+	if(nViews == 0 || imagePoints.size() != objectPoints.size())
+	{
+		cerr << "\033[0;32mERROR: No view to calibrate by BundleAdjuster.\033[0m" << endl;
+		return -1;
+	}
+
+	useGuess = useGuess && !cameraMatrix.empty();
+	cv::Mat K;
+	if(useGuess)
+		cameraMatrix.convertTo(K, CV_64F);
+	else
+	{
+		K = cv::initCameraMatrix2D(objectPoints, imagePoints, imageSize, 0);
+		K.convertTo(K, CV_64F);
+	}
+	vector<char> solved;
+	if(initPoses(objectPoints, imagePoints, K, rotations, translations, solved) < nViews)
+	{
+		cerr << "\033[0;32mERROR: Fail to initialize poses by BundleAdjuster.\033[0m" << endl;
+		return -1;
+	}
+	double cx = K.at<double>(0, 2), cy = K.at<double>(1, 2);
+	vector<double> global(N_INTRINSICS, 0.0);
+	global[0] = K.at<double>(0, 0);
+	global[1] = K.at<double>(1, 1);
+	if(useGuess)
+	{
+		// poses of solvePnP() ignore distortion, so they are refined at the guess too
+		fromCameraParas(cameraMatrix, distCoeffs, &global[0], cx, cy);
+		forViews(nViews, [&](int, int begin, int end)
+		{
+			for(int v = begin; v < end; v++)
+				refinePose(objectPoints[v], imagePoints[v], &global[0], cx, cy,
+						rotations[v], translations[v]);
+		});
+	}
+
+	int nPoints = 0;
+	vector<int> nResiduals(nViews);
+	for(int v = 0; v < nViews; v++)
+	{
+		nResiduals[v] = 2 * (int)imagePoints[v].size();
+		nPoints += (int)imagePoints[v].size();
+	}
+
+	ViewResiduals residualsOf = [&](int v, const double* intrinsics, const cv::Matx33d& R,
+			const cv::Vec3d& t, double* residuals, double* Jg, double* Jp)
+	{
+		viewResiduals(objectPoints[v], imagePoints[v], intrinsics, cx, cy, R, t, residuals, Jg, Jp);
+	};
+
+	double covariance[N_INTRINSICS * N_INTRINSICS];
+	double cost = optimize(N_INTRINSICS, global, nResiduals, residualsOf, covariance);
+	if(cost < 0)
+		return -1;
+
+	toCameraParas(&global[0], cx, cy, cameraMatrix, distCoeffs);
+
+	// covariance of the parameters is sigma^2 * (J^T J)^-1, sigma^2 estimated from residuals
+	int dof = 2 * nPoints - N_INTRINSICS - 6 * nViews;
+	stdDevs = toStdDevs(covariance, N_INTRINSICS, dof > 0 ? cost / dof : 0);
+
+	return sqrt(cost / nPoints);
+}
+
+// calibrate both cameras of a DCM and their relative pose in one optimization,
+// views share intrinsics of both cameras and R, T, and a view has the pose of camera1
+// every camera starts from initCameraMatrix2D() and solvePnP(), which are closed forms of
+// homographies, and R, T start from medians of relative poses of views
+// objectPoints: board model of every view, on the plane z = 0
+// imagePoints1, imagePoints2: detected corners of every view in camera1 and camera2
+// imageSize: image size of both cameras
+// cameraMatrix1, distCoeffs1, cameraMatrix2, distCoeffs2: calibrated intrinsics of both cameras
+// R, T: rotation and translation from camera1 coordinates to camera2 coordinates
+// E, F: essential and fundamental matrices, F normalized by F(2, 2)
+// stdDevs1, stdDevs2: standard deviations of intrinsics of both cameras, as calibrate() does
+// useGuess: start from given intrinsics of both cameras and R, T instead of closed forms
+// return the RMS reprojection error of both cameras as stereoCalibrate() does, or -1 on failure
+double BundleAdjuster::calibrateStereo(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints1,
+		const vector<vector<cv::Point2f> >& imagePoints2, cv::Size imageSize,
+		cv::Mat& cameraMatrix1, cv::Mat& distCoeffs1,
+		cv::Mat& cameraMatrix2, cv::Mat& distCoeffs2,
+		cv::Mat& R, cv::Mat& T, cv::Mat& E, cv::Mat& F,
+		cv::Mat& stdDevs1, cv::Mat& stdDevs2, bool useGuess)
+{
+	const int G = 2 * N_INTRINSICS + 6;
+	int nViews = (int)objectPoints.size();
+	if(nViews == 0 || imagePoints1.size() != objectPoints.size() ||
+			imagePoints2.size() != objectPoints.size())
+	{
+		cerr << "\033[0;32mERROR: No view to calibrate by BundleAdjuster.\033[0m" << endl;
+		return -1;
+	}
+
+	// both cameras are initialized independently, camera2 keeps its poses for R and T only,
+	// with a guess camera2 isn't posed at all, R and T are given
+	useGuess = useGuess && !cameraMatrix1.empty() && !cameraMatrix2.empty() && !R.empty() && !T.empty();
+	cv::Mat K1, K2;
+	if(useGuess)
+	{
+		cameraMatrix1.convertTo(K1, CV_64F);
+		cameraMatrix2.convertTo(K2, CV_64F);
+	}
+	else
+	{
+		K1 = cv::initCameraMatrix2D(objectPoints, imagePoints1, imageSize, 0);
+		K2 = cv::initCameraMatrix2D(objectPoints, imagePoints2, imageSize, 0);
+		K1.convertTo(K1, CV_64F);
+		K2.convertTo(K2, CV_64F);
+	}
+	vector<cv::Matx33d> rotations2;
+	vector<cv::Vec3d> translations2;
+	vector<char> solved;
+	if(initPoses(objectPoints, imagePoints1, K1, rotations, translations, solved) < nViews ||
+			(!useGuess && initPoses(objectPoints, imagePoints2, K2, rotations2, translations2, solved) < nViews))
+	{
+		cerr << "\033[0;32mERROR: Fail to initialize poses by BundleAdjuster.\033[0m" << endl;
+		return -1;
+	}
+
+	// relative pose of every view is R2 * R1^T and t2 - R2 * R1^T * t1, medians of their
+	// rotation vectors and translations are robust to views of poorly initialized poses
+	double median[6];
+	cv::Matx33d base;
+	if(useGuess)
+	{
+		cv::Mat R64, T64;
+		R.convertTo(R64, CV_64F);
+		T.convertTo(T64, CV_64F);
+		for(int i = 0; i < 9; i++)
+			base.val[i] = R64.at<double>(i / 3, i % 3);
+		for(int i = 0; i < 3; i++)
+			median[3 + i] = T64.at<double>(i);
+	}
+	else
+	{
+		vector<double> relative[6];
+		for(int v = 0; v < nViews; v++)
+		{
+			cv::Matx33d Rv = rotations2[v] * rotations[v].t();
+			cv::Vec3d r = rotationVectorOf(Rv);
+			for(int i = 0; i < 3; i++)
+			{
+				double rt = Rv.val[i * 3] * translations[v][0] + Rv.val[i * 3 + 1] * translations[v][1]
+					+ Rv.val[i * 3 + 2] * translations[v][2];
+				relative[i].push_back(r[i]);
+				relative[3 + i].push_back(translations2[v][i] - rt);
+			}
+		}
+		for(int i = 0; i < 6; i++)
+		{
+			nth_element(relative[i].begin(), relative[i].begin() + nViews / 2, relative[i].end());
+			median[i] = relative[i][nViews / 2];
+		}
+		base = rotationOf(cv::Vec3d(median[0], median[1], median[2]));
+	}
+
+	// global parameters are intrinsics of camera1 and camera2, a rotation increment w and T,
+	// the relative rotation is Rodrigues(w) * base, w stays tiny from the median on, where
+	// derivatives of the increment at 0 are accurate enough for Levenberg-Marquardt
+	double cx1 = K1.at<double>(0, 2), cy1 = K1.at<double>(1, 2);
+	double cx2 = K2.at<double>(0, 2), cy2 = K2.at<double>(1, 2);
+	vector<double> global(G, 0.0);
+	global[0] = K1.at<double>(0, 0);
+	global[1] = K1.at<double>(1, 1);
+	global[N_INTRINSICS] = K2.at<double>(0, 0);
+	global[N_INTRINSICS + 1] = K2.at<double>(1, 1);
+	for(int i = 0; i < 3; i++)
+		global[2 * N_INTRINSICS + 3 + i] = median[3 + i];
+	if(useGuess)
+	{
+		fromCameraParas(cameraMatrix1, distCoeffs1, &global[0], cx1, cy1);
+		fromCameraParas(cameraMatrix2, distCoeffs2, &global[N_INTRINSICS], cx2, cy2);
+		forViews(nViews, [&](int, int begin, int end)
+		{
+			for(int v = begin; v < end; v++)
+				refinePose(objectPoints[v], imagePoints1[v], &global[0], cx1, cy1,
+						rotations[v], translations[v]);
+		});
+	}
+
+	int nPoints = 0;
+	vector<int> nResiduals(nViews);
+	for(int v = 0; v < nViews; v++)
+	{
+		nResiduals[v] = 2 * (int)(imagePoints1[v].size() + imagePoints2[v].size());
+		nPoints += (int)imagePoints1[v].size();
+	}
+
+	ViewResiduals residualsOf = [&](int v, const double* parameters, const cv::Matx33d& Rv,
+			const cv::Vec3d& tv, double* residuals, double* Jg, double* Jp)
+	{
+		const double* w = parameters + 2 * N_INTRINSICS;
+		const double* Trel = w + 3;
+		cv::Matx33d Rrel = rotationOf(cv::Vec3d(w[0], w[1], w[2])) * base;
+		const vector<cv::Point3f>& objects = objectPoints[v];
+		const vector<cv::Point2f>& corners1 = imagePoints1[v];
+		const vector<cv::Point2f>& corners2 = imagePoints2[v];
+		int n = (int)corners1.size();
+		if(Jg)
+			fill(Jg, Jg + nResiduals[v] * G, 0.0);
+		for(int j = 0; j < n; j++)
+		{
+			// rows of camera1 come first, then rows of camera2
+			int k1 = j * 2, k2 = 2 * n + j * 2;
+			double X[3] = {objects[j].x, objects[j].y, objects[j].z};
+			double P[3], Xc1[3], Q[3], Xc2[3], uv[2], Jc[6];
+			for(int i = 0; i < 3; i++)
+			{
+				P[i] = Rv.val[i * 3] * X[0] + Rv.val[i * 3 + 1] * X[1] + Rv.val[i * 3 + 2] * X[2];
+				Xc1[i] = P[i] + tv[i];
+			}
+			for(int i = 0; i < 3; i++)
+			{
+				Q[i] = Rrel.val[i * 3] * Xc1[0] + Rrel.val[i * 3 + 1] * Xc1[1] + Rrel.val[i * 3 + 2] * Xc1[2];
+				Xc2[i] = Q[i] + Trel[i];
+			}
+
+			project(parameters, cx1, cy1, Xc1, uv, Jg ? Jg + k1 * G : NULL, G, Jp ? Jc : NULL);
+			residuals[k1] = uv[0] - corners1[j].x;
+			residuals[k1 + 1] = uv[1] - corners1[j].y;
+			if(Jp)
+				poseDerivatives(Jc, P, Jp + k1 * 6);
+
+			project(parameters + N_INTRINSICS, cx2, cy2, Xc2, uv,
+					Jg ? Jg + k2 * G + N_INTRINSICS : NULL, G, (Jg || Jp) ? Jc : NULL);
+			residuals[k2] = uv[0] - corners2[j].x;
+			residuals[k2 + 1] = uv[1] - corners2[j].y;
+			if(Jg)
+			{
+				// by w and T, Xc2 changes as a pose of Q does
+				double Jr[12];
+				poseDerivatives(Jc, Q, Jr);
+				for(int row = 0; row < 2; row++)
+					copy(Jr + row * 6, Jr + row * 6 + 6, Jg + (k2 + row) * G + 2 * N_INTRINSICS);
+			}
+			if(Jp)
+			{
+				// by the pose of the view, through Rrel
+				double JcR[6];
+				for(int row = 0; row < 2; row++)
+					for(int c = 0; c < 3; c++)
+						JcR[row * 3 + c] = Jc[row * 3] * Rrel.val[c] + Jc[row * 3 + 1] * Rrel.val[3 + c]
+							+ Jc[row * 3 + 2] * Rrel.val[6 + c];
+				poseDerivatives(JcR, P, Jp + k2 * 6);
+			}
+		}
+	};
+
+	double covariance[G * G];
+	double cost = optimize(G, global, nResiduals, residualsOf, covariance);
+	if(cost < 0)
+		return -1;
+
+	toCameraParas(&global[0], cx1, cy1, cameraMatrix1, distCoeffs1);
+	toCameraParas(&global[N_INTRINSICS], cx2, cy2, cameraMatrix2, distCoeffs2);
+	int dof = 4 * nPoints - G - 6 * nViews;
+	double sigma2 = dof > 0 ? cost / dof : 0;
+	stdDevs1 = toStdDevs(covariance, G, sigma2);
+	stdDevs2 = toStdDevs(covariance + N_INTRINSICS * G + N_INTRINSICS, G, sigma2);
+
+	// E = [T]x R, F = M2^-T E M1^-1
+	const double* w = &global[2 * N_INTRINSICS];
+	const double* t = w + 3;
+	cv::Matx33d Rrel = rotationOf(cv::Vec3d(w[0], w[1], w[2])) * base;
+	cv::Matx33d Tx(0, -t[2], t[1], t[2], 0, -t[0], -t[1], t[0], 0);
+	cv::Matx33d Em = Tx * Rrel;
+	cv::Matx33d M1(global[0], 0, cx1, 0, global[1], cy1, 0, 0, 1);
+	cv::Matx33d M2(global[N_INTRINSICS], 0, cx2, 0, global[N_INTRINSICS + 1], cy2, 0, 0, 1);
+	cv::Matx33d Fm = M2.inv().t() * Em * M1.inv();
+	if(fabs(Fm.val[8]) > 1e-12)
+		Fm = Fm * (1 / Fm.val[8]);
+	R = cv::Mat(Rrel, true);
+	T = cv::Mat(cv::Vec3d(t[0], t[1], t[2]), true);
+	E = cv::Mat(Em, true);
+	F = cv::Mat(Fm, true);
+
+	return sqrt(cost / (2 * nPoints));
+}
+
+// marginal information of every view about fx, fy, k1, k2, p1, p2, k3 at given intrinsics,
+// that is J^T J of the view with its pose eliminated by the Schur complement, the part of
+// the normal equations calibrate() would add by the view, every view posed by solvePnP()
+// and refinePose(), as a pilot calibration needs not to know poses
+// information: a 7 x 7 matrix of every view, empty if its pose isn't found
+void BundleAdjuster::viewInformation(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints,
+		const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, vector<cv::Mat>& information)
+{
+	const int G = N_INTRINSICS;
+	int nViews = (int)objectPoints.size();
+	double intrinsics[N_INTRINSICS], cx, cy;
+	fromCameraParas(cameraMatrix, distCoeffs, intrinsics, cx, cy);
+	vector<char> solved;
+	initPoses(objectPoints, imagePoints, cameraMatrix, rotations, translations, solved);
+	information.assign(nViews, cv::Mat());
+	forViews(nViews, [&](int, int begin, int end)
+	{
+		vector<double> r, Jg, Jp;
+		for(int v = begin; v < end; v++)
+		{
+			if(!solved[v])
+				continue;
+			refinePose(objectPoints[v], imagePoints[v], intrinsics, cx, cy, rotations[v], translations[v]);
+			int n = 2 * (int)imagePoints[v].size();
+			r.resize(n);
+			Jg.resize(n * G);
+			Jp.resize(n * 6);
+			viewResiduals(objectPoints[v], imagePoints[v], intrinsics, cx, cy,
+					rotations[v], translations[v], &r[0], &Jg[0], &Jp[0]);
+
+			// U - W V^-1 W^T of the view
+			double U[G * G] = {0}, W[G * 6] = {0}, V[36] = {0}, Vinv[36];
+			for(int k = 0; k < n; k++)
+			{
+				const double* jg = &Jg[k * G];
+				const double* jp = &Jp[k * 6];
+				for(int i = 0; i < G; i++)
+				{
+					for(int j = 0; j < G; j++)
+						U[i * G + j] += jg[i] * jg[j];
+					for(int c = 0; c < 6; c++)
+						W[i * 6 + c] += jg[i] * jp[c];
+				}
+				for(int c = 0; c < 6; c++)
+					for(int d = 0; d < 6; d++)
+						V[c * 6 + d] += jp[c] * jp[d];
+			}
+			if(!choleskyInvert(V, 6, Vinv))
+				continue;
+			cv::Mat S(G, G, CV_64F);
+			for(int i = 0; i < G; i++)
+			{
+				for(int j = 0; j < G; j++)
+				{
+					double s = U[i * G + j];
+					for(int c = 0; c < 6; c++)
+						for(int d = 0; d < 6; d++)
+							s -= W[i * 6 + c] * Vinv[c * 6 + d] * W[j * 6 + d];
+					S.at<double>(i, j) = s;
+				}
+			}
+			information[v] = S;
+		}
+	});
+}
+
+// reprojection errors of views at given intrinsics, every view posed by solvePnP() and
+// refinePose(), so views not calibrated with the intrinsics can be assessed too
+// perViewErrors: RMS error of every view, -1 if its pose isn't found
+// perCornerErrors: distance between projected and detected corners of every view, empty
+//                  if its pose isn't found, NULL to skip
+// return the RMS error over all corners of posed views, -1 if no view is posed
+double BundleAdjuster::reprojectionErrors(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints,
+		const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, vector<double>& perViewErrors,
+		vector<vector<float> >* perCornerErrors)
+{
+	int nViews = (int)objectPoints.size();
+	double intrinsics[N_INTRINSICS], cx, cy;
+	fromCameraParas(cameraMatrix, distCoeffs, intrinsics, cx, cy);
+	vector<char> solved;
+	initPoses(objectPoints, imagePoints, cameraMatrix, rotations, translations, solved);
+	vector<double> costs(nViews, 0.0);
+	perViewErrors.assign(nViews, -1.0);
+	if(perCornerErrors)
+		perCornerErrors->assign(nViews, vector<float>());
+	forViews(nViews, [&](int, int begin, int end)
+	{
+		vector<double> r;
+		for(int v = begin; v < end; v++)
+		{
+			if(!solved[v] || imagePoints[v].empty())
+				continue;
+			costs[v] = refinePose(objectPoints[v], imagePoints[v], intrinsics, cx, cy,
+					rotations[v], translations[v]);
+			perViewErrors[v] = sqrt(costs[v] / imagePoints[v].size());
+			if(!perCornerErrors)
+				continue;
+			int n = (int)imagePoints[v].size();
+			r.resize(2 * n);
+			viewResiduals(objectPoints[v], imagePoints[v], intrinsics, cx, cy,
+					rotations[v], translations[v], &r[0], NULL, NULL);
+			vector<float>& errors = (*perCornerErrors)[v];
+			errors.resize(n);
+			for(int j = 0; j < n; j++)
+				errors[j] = (float)sqrt(r[j * 2] * r[j * 2] + r[j * 2 + 1] * r[j * 2 + 1]);
+		}
+	});
+
+	double cost = 0;
+	int nPoints = 0;
+	for(int v = 0; v < nViews; v++)
+	{
+		if(perViewErrors[v] < 0)
+			continue;
+		cost += costs[v];
+		nPoints += (int)imagePoints[v].size();
+	}
+	return nPoints > 0 ? sqrt(cost / nPoints) : -1;
+}
+
+// rotation vectors and translations of every view of the last solve
+void BundleAdjuster::getPoses(vector<cv::Mat>& rvecs, vector<cv::Mat>& tvecs)
+{
+	rvecs.clear();
+	tvecs.clear();
+	for(size_t v = 0; v < rotations.size(); v++)
+	{
+		cv::Vec3d r = rotationVectorOf(rotations[v]);
+		cv::Mat rvec(3, 1, CV_64F), tvec(3, 1, CV_64F);
+		for(int i = 0; i < 3; i++)
+		{
+			rvec.at<double>(i) = r[i];
+			tvec.at<double>(i) = translations[v][i];
+		}
+		rvecs.push_back(rvec);
+		tvecs.push_back(tvec);
+	}
+}
+
+// iterations of the last solve
+int BundleAdjuster::getnIterations()
+{
+	return nIterations;
+}
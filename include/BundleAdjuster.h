@@ -0,0 +1,71 @@
+#ifndef BUNDLE_ADJUSTER_H_
+#define BUNDLE_ADJUSTER_H_
+
+#include <vector>
+#include <functional>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// residuals of one view and their derivatives, filled by a model of BundleAdjuster
+// view: index of the view
+// global: parameters shared by all views
+// R, t: pose of the view, which transforms board points into camera coordinates
+// residuals: projected minus detected coordinates of every corner
+// Jg: derivatives of residuals by global parameters, a row per residual, NULL to skip
+// Jp: derivatives of residuals by the rotation increment and t, 6 per row, NULL to skip
+typedef function<void(int view, const double* global, const cv::Matx33d& R, const cv::Vec3d& t,
+		double* residuals, double* Jg, double* Jp)> ViewResiduals;
+
+// BundleAdjuster calibrates cameras by Levenberg-Marquardt on the block-sparse structure
+// of the problem: intrinsics are shared by all views while a pose belongs to one view,
+// so the normal equations are reduced to the shared parameters by the Schur complement
+// and every pose is solved by its own 6x6 system. The cost grows linearly with views,
+// instead of cubically as a dense solver does, and Jacobians are analytic and evaluated
+// on nThreads threads, each of them taking a range of views.
+// The camera model is the one of Calibrator::calibrate(): fx, fy, k1, k2, p1, p2, k3,
+// the principal point is fixed at the initial guess of initCameraMatrix2D().
+// calibrateStereo() solves both cameras of a DCM and R, T between them jointly, so
+// intrinsics are refined by both cameras together in a single optimization.
+class BundleAdjuster
+{
+	private:
+		int nThreads;             // threads evaluating Jacobians, 0 means all cores
+		int maxIterations;        // most iterations of Levenberg-Marquardt
+		double epsilon;           // iterations stop once the cost decreases relatively less
+		int nIterations;          // iterations of the last solve
+		vector<cv::Matx33d> rotations;   // rotation of every view
+		vector<cv::Vec3d> translations;  // translation of every view
+
+		int getnWorkers(int nViews);
+		void forViews(int nViews, const function<void(int worker, int begin, int end)>& work);
+		int initPoses(const vector<vector<cv::Point3f> >& objectPoints,
+				const vector<vector<cv::Point2f> >& imagePoints, const cv::Mat& cameraMatrix,
+				vector<cv::Matx33d>& R, vector<cv::Vec3d>& t, vector<char>& solved);
+		double optimize(int nGlobal, vector<double>& global, const vector<int>& nResiduals,
+				const ViewResiduals& residualsOf, double* covariance);
+
+	public:
+		BundleAdjuster(int nThreads = 0, int maxIterations = 100, double epsilon = 1e-10);
+		double calibrate(const vector<vector<cv::Point3f> >& objectPoints,
+				const vector<vector<cv::Point2f> >& imagePoints, cv::Size imageSize,
+				cv::Mat& cameraMatrix, cv::Mat& distCoeffs, cv::Mat& stdDevs, bool useGuess = false);
+		double calibrateStereo(const vector<vector<cv::Point3f> >& objectPoints,
+				const vector<vector<cv::Point2f> >& imagePoints1,
+				const vector<vector<cv::Point2f> >& imagePoints2, cv::Size imageSize,
+				cv::Mat& cameraMatrix1, cv::Mat& distCoeffs1,
+				cv::Mat& cameraMatrix2, cv::Mat& distCoeffs2,
+				cv::Mat& R, cv::Mat& T, cv::Mat& E, cv::Mat& F,
+				cv::Mat& stdDevs1, cv::Mat& stdDevs2, bool useGuess = false);
+		void viewInformation(const vector<vector<cv::Point3f> >& objectPoints,
+				const vector<vector<cv::Point2f> >& imagePoints,
+				const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, vector<cv::Mat>& information);
+		double reprojectionErrors(const vector<vector<cv::Point3f> >& objectPoints,
+				const vector<vector<cv::Point2f> >& imagePoints,
+				const cv::Mat& cameraMatrix, const cv::Mat& distCoeffs, vector<double>& perViewErrors,
+				vector<vector<float> >* perCornerErrors = NULL);
+		void getPoses(vector<cv::Mat>& rvecs, vector<cv::Mat>& tvecs);
+		int getnIterations();
+};
+
+#endif
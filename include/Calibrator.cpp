@@ -1,10 +1,83 @@
 #include "Calibrator.h"
 
 #include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <exception>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#endif
+
+// 64-bit FNV-1a hash of size bytes at data, continuing from hash
+static uint64_t hashBytes(const void* data, size_t size,
+		uint64_t hash = 14695981039346656037ULL)
+{
+	const uchar* bytes = (const uchar*)data;
+	for(size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// peak resident memory of this process in MB, 0 if it's unknown on this OS
+static double peakMemoryMB()
+{
+#if defined(__APPLE__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / (1024.0 * 1024.0);   // bytes on Mac OS
+#elif defined(__unix__)
+	struct rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss / 1024.0;              // kilobytes on Linux
+#else
+	return 0;
+#endif
+}
+
+// calibrate one camera with the camera model of calibrate(), the principal point is fixed
+// stdDevs: standard deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3,
+//          calibrateCamera() needs OpenCV 3.2 or later for them, and they are empty before it
+// solver: SOLVER_OPENCV or SOLVER_SPARSE
+// nThreads: threads of BundleAdjuster with SOLVER_SPARSE, 0 means all cores
+// useGuess: start from cameraMatrix and distCoeffs, as a re-solve after dropping views does
+// return the RMS reprojection error, -1 if BundleAdjuster fails
+static double calibrateOne(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints, cv::Size imageSize,
+		cv::Mat& cameraMatrix, cv::Mat& distCoeffs, cv::Mat& stdDevs,
+		int solver, int nThreads, bool useGuess = false)
+{
+	if(solver == SOLVER_SPARSE)
+	{
+		BundleAdjuster adjuster(nThreads);
+		return adjuster.calibrate(objectPoints, imagePoints, imageSize,
+				cameraMatrix, distCoeffs, stdDevs, useGuess);
+	}
+	int flags = cv::CALIB_FIX_PRINCIPAL_POINT;
+	if(useGuess && !cameraMatrix.empty())
+		flags |= cv::CALIB_USE_INTRINSIC_GUESS;
+#if CV_VERSION_MAJOR > 3 || (CV_VERSION_MAJOR == 3 && CV_VERSION_MINOR >= 2)
+	return cv::calibrateCamera(objectPoints, imagePoints, imageSize,
+		cameraMatrix, distCoeffs, cv::noArray(), cv::noArray(),
+		stdDevs, cv::noArray(), cv::noArray(), flags);
+#else
+	stdDevs.release();
+	return cv::calibrateCamera(objectPoints, imagePoints, imageSize,
+		cameraMatrix, distCoeffs, cv::noArray(), cv::noArray(), flags);
+#endif
+}
+
 // Constructors
 // initializing
 Calibrator::Calibrator()
@@ -16,6 +89,32 @@ Calibrator::Calibrator()
 	n_boards = 0;
 	squareWidth = 0.f;
 	flag = 0;
+	nThreads = 0;
+	displayMode = DISPLAY_STEP;
+	subPixWindow = cv::Size(11, 11);
+	subPixCriteria = cv::TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 300, 0.01);
+	useCornerCache = false;
+	prefetchDepth = 0;
+	pyramidWidth = 0;
+	fastReject = false;
+	nRejected = 0;
+	detector = DETECTOR_OPENCV;
+	refiner = SUBPIX_OPENCV;
+	solver = SOLVER_OPENCV;
+	stereoMode = STEREO_SEQUENTIAL;
+	nSelectedViews = 0;
+	outlierSigma = 0;
+	nFolds = 0;
+	heldOutError = -1;
+	rmsError1 = -1;
+	rmsError2 = -1;
+	focalTarget = 1.0;
+	principalTarget = 1.0;
+	distortionTarget = 0.005;
+	nEstimatedViews = 0;
+	nRequestedViews = 0;
+	estimating = false;
+	nCacheHits = 0;
 	filename = "";
 	imageNames = NULL;
 	imageNames1 = NULL;
@@ -37,6 +136,32 @@ Calibrator::Calibrator(int imageWidth, int imageHeight,
 	this->squareWidth = squareWidth;
 	this->flag = flag;
 	this->filename = filename;
+	nThreads = 0;
+	displayMode = DISPLAY_STEP;
+	subPixWindow = cv::Size(11, 11);
+	subPixCriteria = cv::TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 300, 0.01);
+	useCornerCache = false;
+	prefetchDepth = 0;
+	pyramidWidth = 0;
+	fastReject = false;
+	nRejected = 0;
+	detector = DETECTOR_OPENCV;
+	refiner = SUBPIX_OPENCV;
+	solver = SOLVER_OPENCV;
+	stereoMode = STEREO_SEQUENTIAL;
+	nSelectedViews = 0;
+	outlierSigma = 0;
+	nFolds = 0;
+	heldOutError = -1;
+	rmsError1 = -1;
+	rmsError2 = -1;
+	focalTarget = 1.0;
+	principalTarget = 1.0;
+	distortionTarget = 0.005;
+	nEstimatedViews = 0;
+	nRequestedViews = 0;
+	estimating = false;
+	nCacheHits = 0;
 	imageNames = NULL;
 	imageNames1 = NULL;
 	imageNames2 = NULL;
@@ -54,6 +179,32 @@ Calibrator::Calibrator(string filename)
 	n_boards = 0;
 	squareWidth = 0.f;
 	flag = 0;
+	nThreads = 0;
+	displayMode = DISPLAY_STEP;
+	subPixWindow = cv::Size(11, 11);
+	subPixCriteria = cv::TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 300, 0.01);
+	useCornerCache = false;
+	prefetchDepth = 0;
+	pyramidWidth = 0;
+	fastReject = false;
+	nRejected = 0;
+	detector = DETECTOR_OPENCV;
+	refiner = SUBPIX_OPENCV;
+	solver = SOLVER_OPENCV;
+	stereoMode = STEREO_SEQUENTIAL;
+	nSelectedViews = 0;
+	outlierSigma = 0;
+	nFolds = 0;
+	heldOutError = -1;
+	rmsError1 = -1;
+	rmsError2 = -1;
+	focalTarget = 1.0;
+	principalTarget = 1.0;
+	distortionTarget = 0.005;
+	nEstimatedViews = 0;
+	nRequestedViews = 0;
+	estimating = false;
+	nCacheHits = 0;
 	this->filename = filename;
 	imageNames = NULL;
 	imageNames1 = NULL;
@@ -65,6 +216,7 @@ Calibrator::Calibrator(string filename)
 // class destructor
 Calibrator::~Calibrator()
 {
+	waitUncertainty();
 	delete [] imageNames;
 	delete [] imageNames1;
 	delete [] imageNames2;
@@ -89,259 +241,1868 @@ void Calibrator::setCalibParas(int imageWidth, int imageHeight,
 	board_n = board_w * board_h;
 }
 
-// set names of calibrated images
-// naming rules: 
-// img_0i if 1 <= i < 9 and img_i if i >= 10 when flag = 0;
-// img1_0i or img2_0i if 1 <= i < 9 and img1_i or img2_i if i >= 10 when flag = 1;
-void Calibrator::setImageNames()
+// set names of calibrated images
+// naming rules: 
+// img_0i if 1 <= i < 9 and img_i if i >= 10 when flag = 0;
+// img1_0i or img2_0i if 1 <= i < 9 and img1_i or img2_i if i >= 10 when flag = 1;
+void Calibrator::setImageNames()
+{
+	stringstream ss;
+	if(flag == FLAG_SINGLE_CAMERA)
+	{
+		imageNames = new string[n_boards];  
+		for(int i = 0; i < n_boards; i++)
+		{
+			ss.str("");  // clear ss
+			if(i < 9)
+			{
+				ss << "img_0" << (i + 1) << ".jpg";
+				imageNames[i] = ss.str();
+			}
+			else
+			{
+				ss << "img_" << (i + 1) << ".jpg";
+				imageNames[i] = ss.str();
+			}
+		}
+	}
+
+	if(flag == FLAG_DOUBLE_CAMERAS)
+	{
+		imageNames1 = new string[n_boards];
+		imageNames2 = new string[n_boards];
+		for(int i = 0; i < n_boards; i++)
+		{
+			ss.str("");
+			if(i < 9)
+			{
+				ss << "img1_0" << (i + 1) << ".jpg";
+				imageNames1[i] = ss.str();
+				ss.str("");
+				ss << "img2_0" << (i + 1) << ".jpg";
+				imageNames2[i] = ss.str();
+			}
+			else
+			{
+				ss << "img1_" << (i + 1) << ".jpg";
+				imageNames1[i] = ss.str();
+				ss.str("");
+				ss << "img2_" << (i + 1) << ".jpg";
+				imageNames2[i] = ss.str();
+			}
+		}
+	}
+	ss.clear();
+}
+
+// save framenumber-th images into indicated directory
+// image names comes from imageNames if flag = 0 
+// or imageNames1 and imageNames2 if flag = 1 
+// frame1: captured images by one camera or camera1 of DCM
+// frame2: captured images by camera2 of DCM, default value is cv::Mat() if flag = 0
+// images are written by writer in background, see waitSavedImages()
+void Calibrator::saveImages(int frameNumber, string directory,
+		cv::Mat frame1, cv::Mat frame2)
+{
+	cout << "\033[0;32mContinue capturing pictures\033[0m\n";
+	cout << "\033[0;32mSave \033[0m" << (frameNumber + 1) << " \033[0;32mpicture(s).\033[0m\n\n";
+
+	if(flag == FLAG_SINGLE_CAMERA)
+		writer.write(directory + imageNames[frameNumber], frame1);
+
+	if(flag == FLAG_DOUBLE_CAMERAS)
+	{
+		writer.write(directory + imageNames1[frameNumber], frame1);
+		writer.write(directory + imageNames2[frameNumber], frame2);
+	}
+}
+
+// wait until all images of saveImages() are written, it's called by calcCameraParas()
+// return true if all of them are written, otherwise failed images are printed
+bool Calibrator::waitSavedImages()
+{
+	writer.wait();
+	vector<string> failures = writer.getFailures();
+	for(size_t i = 0; i < failures.size(); i++)
+		cerr << "\033[0;32mERROR: Fail to save image \033[0m" << failures[i] << endl;
+	return failures.empty();
+}
+
+// store cordinates or inner corners in a vector<cv::Point3f>
+vector<cv::Point3f> Calibrator::setBoardModel()
+{
+	vector<cv::Point3f> opts;
+	opts.resize(board_n);
+	for(int j = 0; j < board_n; j++)
+	{
+		opts[j] = cv::Point3f((float)(j / board_w * squareWidth),
+				(float)((j % board_w) * squareWidth), 0.f);
+	}
+	return opts;
+}
+
+// store camera parameters into filename(.xml or .yml) after calibrating
+// please notice names of variables in the file 
+// avgError: the average distance between points in one image and epiline in another image
+//           its default value is 0.
+// reprojection errors of every view of the last calibrate() are stored by saveErrorReport()
+void Calibrator::saveCameraParas(double avgError)
+{
+	this->filename = filename;
+	cout << "\n\033[0;32mStoring calibrated parameters in \033[0m" << filename << endl;
+	cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+
+	if(flag == FLAG_SINGLE_CAMERA)
+	{
+		fs << "image_width" << imageWidth
+			<< "image_height" << imageHeight
+			<< "camera_matrix" << cameraMatrix1
+			<< "distortion_coefficients" << distCoeffs1;
+	}
+	
+	if(flag == FLAG_DOUBLE_CAMERAS)
+	{
+		fs << "camera1_width" << imageWidth
+			<< "camera1_height" << imageHeight
+			<< "camera1_intrinsics" << cameraMatrix1
+			<< "camera1_distortion_coeffs" << distCoeffs1
+			<< "camera2_width" << imageWidth
+			<< "camera2_height" << imageHeight
+			<< "camera2_intrinsics" << cameraMatrix2
+			<< "camera2_distortion_coeffs" << distCoeffs2
+			<< "camera2_to_camera1_rotation" << R
+			<< "camera2_to_camera1_translation" << T
+			<< "assess_error" << avgError;
+	}
+	fs.release();
+	saveErrorReport();
+}
+
+// cheap check whether gray may contain a chessboard, it takes well under a millisecond
+// a saddle response dxy^2 - dxx*dyy is computed on a thumbnail no wider than 320,
+// it's strong at X-junctions between squares and weak on edges, lines and blobs,
+// so a frame with fewer strong saddle peaks than half of inner corners has no chessboard
+// gray: gray calibrated image
+// return false if there is surely no whole chessboard
+bool Calibrator::quickCheckBoard(const cv::Mat& gray)
+{
+	cv::Mat thumb = gray;
+	if(gray.cols > 320)
+		cv::resize(gray, thumb, cv::Size(320, gray.rows * 320 / gray.cols), 0, 0, cv::INTER_AREA);
+
+	cv::Mat dxx, dyy, dxy, saddle;
+	cv::Sobel(thumb, dxx, CV_32F, 2, 0, 3);
+	cv::Sobel(thumb, dyy, CV_32F, 0, 2, 3);
+	cv::Sobel(thumb, dxy, CV_32F, 1, 1, 3);
+	saddle = dxy.mul(dxy) - dxx.mul(dyy);
+
+	// dxy is twice the contrast at an ideal X-junction, 900 means a contrast of 15 gray levels
+	double maxResponse = 0;
+	cv::minMaxLoc(saddle, NULL, &maxResponse);
+	float threshold = (float)max(900.0, 0.1 * maxResponse);
+
+	cv::Mat peaks;
+	cv::dilate(saddle, peaks, cv::Mat());
+	int nPeaks = 0;
+	for(int y = 1; y < saddle.rows - 1; y++)
+	{
+		const float* r = saddle.ptr<float>(y);
+		const float* p = peaks.ptr<float>(y);
+		for(int x = 1; x < saddle.cols - 1; x++)
+			nPeaks += r[x] > threshold && r[x] >= p[x];
+	}
+	return nPeaks * 2 >= board_n;
+}
+
+// detect inner corners on image and refine them to subpixel accuracy
+// if fastReject is true, frames without a chessboard are rejected by quickCheckBoard()
+// and findChessboardCorners() with CALIB_CB_FAST_CHECK before the full detection
+// if pyramidWidth > 0 and image is wider, the chessboard is found on a pyramid level
+// no wider than pyramidWidth, and its corners are mapped up and refined on image
+// the chessboard is found by findChessboardCorners() or saddleDetector, as detector says
+// image: calibrated image, gray as it's read and captured, a color image is converted first,
+//        a gray image is never written, so it may share its buffer with the caller
+// corners: detected inner corners, empty if the chessboard is rejected
+// return true if all inner corners are found
+bool Calibrator::detectCorners(cv::Mat& image, vector<cv::Point2f>& corners)
+{
+	corners.clear();
+	if(image.empty())
+		return false;
+	if(image.channels() != 1)
+		cv::cvtColor(image, image, CV_RGB2GRAY);
+
+	int flags = cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE;
+	if(fastReject)
+	{
+		if(!quickCheckBoard(image))
+		{
+			nRejected++;
+			return false;
+		}
+		flags += cv::CALIB_CB_FAST_CHECK;
+	}
+
+	// every pyrDown halves the image, and a corner at x on it is at 2x on its source
+	cv::Mat level = image;
+	float scale = 1.f;
+	if(pyramidWidth > 0)
+	{
+		while(level.cols > pyramidWidth)
+		{
+			cv::pyrDown(level, level);
+			scale *= 2.f;
+		}
+	}
+
+	bool found = false;
+	if(detector == DETECTOR_SADDLE)
+		found = saddleDetector.detect(level, board_sz, corners);
+	else
+		found = cv::findChessboardCorners(level, board_sz, corners, flags);
+	if(scale > 1.f)
+	{
+		for(size_t j = 0; j < corners.size(); j++)
+			corners[j] *= scale;
+	}
+
+	if(!corners.empty())
+		refineCorners(image, corners);
+	return found;
+}
+
+// refine corners to subpixel accuracy by cornerSubPix() or subPixRefiner, as refiner says
+// gray: gray image corners are found on
+// corners: inner corners to refine in place
+void Calibrator::refineCorners(const cv::Mat& gray, vector<cv::Point2f>& corners)
+{
+	if(refiner == SUBPIX_KERNEL)
+		subPixRefiner.refine(gray, board_sz, corners, subPixWindow, subPixCriteria);
+	else
+		cornerSubPix(gray, corners, subPixWindow, cv::Size(-1, -1), subPixCriteria);
+}
+
+// read one image and look it up in cornerCache, it's the I/O stage of detecting
+// the image is decoded into gray directly, since corners are detected on gray only
+// path: path of calibrated image
+// loaded: read image, with corners if they are cached
+// withImage: whether the image is needed even if its corners are cached
+void Calibrator::loadImage(string path, LoadedImage& loaded, bool withImage)
+{
+	vector<uchar> bytes;
+	ifstream file(path.c_str(), ios::binary);
+	if(file)
+		bytes.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+
+	loaded.key = "";
+	loaded.cached = false;
+	loaded.found = false;
+	loaded.corners.clear();
+	if(useCornerCache && !bytes.empty())
+	{
+		loaded.key = cornerCacheKey(bytes);
+		lock_guard<mutex> lock(cacheMutex);
+		map<string, BoardDetection>::iterator it = cornerCache.find(loaded.key);
+		if(it != cornerCache.end())
+		{
+			loaded.cached = true;
+			loaded.found = it->second.found;
+			loaded.corners = it->second.corners;
+			nCacheHits++;
+		}
+	}
+
+	loaded.image.release();
+	if(!bytes.empty() && (withImage || !loaded.cached))
+		loaded.image = cv::imdecode(bytes, cv::IMREAD_GRAYSCALE);
+}
+
+// detect corners of an image from loadImage(), and release its pixels
+// corners are taken from cornerCache without detecting if useCornerCache is true
+// and the same image was detected with the same parameters before
+// loaded: image from loadImage()
+// corners: detected inner corners
+// view: gray image with drawn corners if it isn't NULL
+// return true if all inner corners are found
+bool Calibrator::detectLoaded(LoadedImage& loaded, vector<cv::Point2f>& corners, cv::Mat* view)
+{
+	cv::Mat image = loaded.image;
+	loaded.image.release();
+
+	bool found = loaded.found;
+	if(!loaded.cached)
+	{
+		found = detectCorners(image, corners);
+		if(!loaded.key.empty())
+		{
+			lock_guard<mutex> lock(cacheMutex);
+			BoardDetection& detection = cornerCache[loaded.key];
+			detection.found = found;
+			detection.corners = corners;
+		}
+	}
+	else
+		corners.swap(loaded.corners);
+
+	if(view != NULL && !image.empty())
+	{
+		drawChessboardCorners(image, board_sz, corners, found);
+		*view = image;
+	}
+	return found;
+}
+
+// read and detect one image, its pixels are released before return
+// path: path of calibrated image
+// corners: detected inner corners
+// view: gray image with drawn corners if it isn't NULL
+// return true if all inner corners are found
+bool Calibrator::detectImage(string path, vector<cv::Point2f>& corners, cv::Mat* view)
+{
+	LoadedImage loaded;
+	loadImage(path, loaded, view != NULL);
+	return detectLoaded(loaded, corners, view);
+}
+
+// key of an image in cornerCache, it hashes both the image file
+// and every parameter changing detected corners, including how the image is decoded,
+// cacheVersion is raised whenever detection changes in a way parameters don't show
+// bytes: content of the image file
+string Calibrator::cornerCacheKey(const vector<uchar>& bytes)
+{
+	const int cacheVersion = 2;
+	uint64_t hash = hashBytes(bytes.data(), bytes.size());
+	int paras[] = {cacheVersion, cv::IMREAD_GRAYSCALE, board_sz.width, board_sz.height,
+		subPixWindow.width, subPixWindow.height,
+		subPixCriteria.type, subPixCriteria.maxCount, pyramidWidth, fastReject, detector, refiner};
+	hash = hashBytes(paras, sizeof(paras), hash);
+	hash = hashBytes(&subPixCriteria.epsilon, sizeof(subPixCriteria.epsilon), hash);
+
+	char key[20];
+	snprintf(key, sizeof(key), "h%016llx", (unsigned long long)hash);
+	return key;
+}
+
+// load cached corners from cacheFile into cornerCache, nothing is loaded if it doesn't exist
+void Calibrator::loadCornerCache(string cacheFile)
+{
+	cv::FileStorage fs(cacheFile, cv::FileStorage::READ);
+	if(!fs.isOpened())
+		return;
+
+	cv::FileNode boards = fs["boards"];
+	for(cv::FileNodeIterator it = boards.begin(); it != boards.end(); ++it)
+	{
+		BoardDetection& detection = cornerCache[(string)(*it)["key"]];
+		detection.found = (int)(*it)["found"] != 0;
+		(*it)["corners"] >> detection.corners;
+	}
+	fs.release();
+}
+
+// save all entries of cornerCache into cacheFile
+void Calibrator::saveCornerCache(string cacheFile)
+{
+	cv::FileStorage fs(cacheFile, cv::FileStorage::WRITE);
+	if(!fs.isOpened())
+	{
+		cerr << "\033[0;32mERROR: Fail to open\033[0m " << cacheFile << endl;
+		return;
+	}
+
+	fs << "boards" << "[";
+	for(map<string, BoardDetection>::iterator it = cornerCache.begin(); it != cornerCache.end(); ++it)
+	{
+		fs << "{" << "key" << it->first
+			<< "found" << (int)it->second.found
+			<< "corners" << it->second.corners << "}";
+	}
+	fs << "]";
+	fs.release();
+}
+
+// read and detect images of n_boards boards with nThreads threads
+// a prefetching thread reads and decodes images in order into a queue of prefetchDepth images,
+// while detecting threads take images from the queue, so reading of following images
+// overlaps with detecting of former ones and memory is bounded by the queue
+// both images of a pair are separate tasks if flag = 1, so they are detected in parallel too
+// directory: directory of calibrated images
+// detections1: detections of imageNames, or imageNames1 if flag = 1
+// detections2: detections of imageNames2 if flag = 1
+// detections1[i] and detections2[i] always belong to board i whichever thread handles it
+void Calibrator::detectBoards(string directory,
+		vector<BoardDetection>& detections1, vector<BoardDetection>& detections2)
+{
+	int nCameras = flag == FLAG_DOUBLE_CAMERAS ? 2 : 1;
+	int nTasks = n_boards * nCameras;
+	detections1.assign(n_boards, BoardDetection());
+	if(nCameras == 2)
+		detections2.assign(n_boards, BoardDetection());
+
+	int threads = nThreads > 0 ? nThreads : (int)thread::hardware_concurrency();
+	if(threads > nTasks)
+		threads = nTasks;
+	if(threads < 1)
+		threads = 1;
+	int depth = prefetchDepth > 0 ? prefetchDepth : 2 * threads;
+
+	// the first exception of any thread closes the queue, so every thread stops soon,
+	// and it's thrown again once all threads are joined
+	exception_ptr failure;
+	mutex failureMutex;
+	atomic<bool> failed(false);
+
+	// task t is image of camera (t % nCameras) on board (t / nCameras)
+	BlockingQueue<LoadedImage> loadedImages(depth);
+	auto fail = [&]()
+	{
+		{
+			lock_guard<mutex> lock(failureMutex);
+			if(!failure)
+				failure = current_exception();
+		}
+		failed = true;
+		loadedImages.close();
+	};
+	double readTime = 0;
+	thread reader([&]()
+	{
+		int64 start = cv::getTickCount();
+		try
+		{
+			for(int t = 0; t < nTasks && !failed; t++)
+			{
+				int i = t / nCameras;
+				string name = nCameras == 1 ? imageNames[i] :
+					(t % nCameras == 1 ? imageNames2[i] : imageNames1[i]);
+				LoadedImage loaded;
+				loaded.task = t;
+				loadImage(directory + name, loaded, displayMode == DISPLAY_PREVIEW);
+				if(!loadedImages.push(loaded))
+					break;
+			}
+		}
+		catch(...)
+		{
+			fail();
+		}
+		loadedImages.close();
+		readTime = (cv::getTickCount() - start) / cv::getTickFrequency();
+	});
+
+	// every thread takes the next read image until all images are handled
+	vector<double> busyTimes(threads, 0);
+	auto worker = [&](int id)
+	{
+		try
+		{
+			LoadedImage loaded;
+			while(!failed && loadedImages.pop(loaded))
+			{
+				int i = loaded.task / nCameras;
+				bool second = loaded.task % nCameras == 1;
+				string window = nCameras == 1 ? "Calibration" :
+					(second ? "Calibration (camera2)" : "Calibration (camera1)");
+				BoardDetection& detection = second ? detections2[i] : detections1[i];
+
+				int64 start = cv::getTickCount();
+				cv::Mat view;
+				detection.found = detectLoaded(loaded, detection.corners,
+						displayMode == DISPLAY_PREVIEW ? &view : NULL);
+				if(displayMode == DISPLAY_PREVIEW)
+					viewer.show(window, view);
+				busyTimes[id] += (cv::getTickCount() - start) / cv::getTickFrequency();
+			}
+		}
+		catch(...)
+		{
+			fail();
+		}
+	};
+
+	int64 start = cv::getTickCount();
+	vector<thread> pool;
+	for(int id = 1; id < threads; id++)
+		pool.push_back(thread(worker, id));
+	worker(0);
+	for(size_t k = 0; k < pool.size(); k++)
+		pool[k].join();
+	reader.join();
+	if(failure)
+		rethrow_exception(failure);
+	double wallTime = (cv::getTickCount() - start) / cv::getTickFrequency();
+
+	// busy time is the sum of time spent on detecting every image, namely the serial cost
+	double busyTime = 0;
+	for(int id = 0; id < threads; id++)
+		busyTime += busyTimes[id];
+	cout << "\n\033[0;32mDetected \033[0m" << nTasks
+		<< "\033[0;32m images with \033[0m" << threads
+		<< "\033[0;32m thread(s) in \033[0m" << wallTime * 1000 << " ms"
+		<< "\033[0;32m (busy \033[0m" << busyTime * 1000 << " ms"
+		<< "\033[0;32m, speedup \033[0m" << (wallTime > 0 ? busyTime / wallTime : 1)
+		<< "\033[0;32m)\033[0m";
+	cout << "\n\033[0;32mRead and decoded them ahead in \033[0m" << readTime * 1000 << " ms"
+		<< "\033[0;32m with \033[0m" << depth << "\033[0;32m image(s) prefetched\033[0m" << endl;
+}
+
+// read, detect and show images of every board one by one for DISPLAY_STEP,
+// so that only images of the board on show are kept in memory
+// directory: directory of calibrated images
+// detections1: detections of imageNames, or imageNames1 if flag = 1
+// detections2: detections of imageNames2 if flag = 1
+void Calibrator::detectBoardsStepwise(string directory,
+		vector<BoardDetection>& detections1, vector<BoardDetection>& detections2)
+{
+	detections1.assign(n_boards, BoardDetection());
+	if(flag == FLAG_DOUBLE_CAMERAS)
+		detections2.assign(n_boards, BoardDetection());
+
+	for(int i = 0; i < n_boards; i++)
+	{
+		cv::Mat view1, view2;
+		if(flag == FLAG_SINGLE_CAMERA)
+		{
+			detections1[i].found = detectImage(directory + imageNames[i],
+					detections1[i].corners, &view1);
+			cv::imshow("Calibration", view1);
+		}
+		if(flag == FLAG_DOUBLE_CAMERAS)
+		{
+			detections1[i].found = detectImage(directory + imageNames1[i],
+					detections1[i].corners, &view1);
+			detections2[i].found = detectImage(directory + imageNames2[i],
+					detections2[i].corners, &view2);
+			cv::imshow("Calibration (camera1)", view1);
+			cv::imshow("Calibration (camera2)", view2);
+		}
+		if(cv::waitKey(1000) == 27)
+			exit(0);
+	}
+	cv::destroyAllWindows();
+}
+
+// detect inner corners on a live frame without collecting them, e.g. to re-detect
+// a chessboard lost by a CornerTracker, frames without a chessboard are rejected cheaply
+// frame: captured image, it isn't changed
+// corners: detected inner corners after subpixel refinement
+// return true if the whole chessboard is found
+bool Calibrator::findBoard(cv::Mat frame, vector<cv::Point2f>& corners)
+{
+	return detectCorners(frame, corners);
+}
+
+// detect corners on frames captured just now and collect them for calibrate(),
+// frames are never written into disk, use saveImages() if you want to keep them
+// frame1: captured gray image by one camera or camera1 of DCM
+// frame2: captured gray image by camera2 of DCM, default value is cv::Mat() if flag = 0
+// return true if the whole chessboard is found on every frame and corners are collected
+bool Calibrator::addFrame(cv::Mat frame1, cv::Mat frame2)
+{
+	if(flag == FLAG_SINGLE_CAMERA)
+	{
+		vector<cv::Point2f> corners;
+		bool found = detectCorners(frame1, corners);
+		cout << "\n\033[0;32mfindChessboardCorners state: \033[0m" << found << endl;
+		if(!found)
+			return false;
+		imagePoints1.push_back(corners);
+	}
+
+	if(flag == FLAG_DOUBLE_CAMERAS)
+	{
+		// camera2 is detected on another thread while camera1 is detected on this one
+		vector<cv::Point2f> corners1, corners2;
+		bool found2 = false;
+		exception_ptr failure;
+		thread detect2([&]()
+		{
+			try
+			{
+				found2 = detectCorners(frame2, corners2);
+			}
+			catch(...)
+			{
+				failure = current_exception();
+			}
+		});
+		bool found1 = false;
+		try
+		{
+			found1 = detectCorners(frame1, corners1);
+		}
+		catch(...)
+		{
+			detect2.join();
+			throw;
+		}
+		detect2.join();
+		if(failure)
+			rethrow_exception(failure);
+		cout << "\n\033[0;32mfindChessboardCorners state (camera1): \033[0m" << found1;
+		cout << "\n\033[0;32mfindChessboardCorners state (camera2): \033[0m" << found2 << endl;
+		if(!found1 || !found2)
+			return false;
+		imagePoints1.push_back(corners1);
+		imagePoints2.push_back(corners2);
+	}
+
+	objectPoints.push_back(setBoardModel());
+	cout << "\033[0;32mCollected our \033[0m" << getnFrames()
+		<< "\033[0;32m of \033[0m" << n_boards
+		<< "\033[0;32m needed chessboard images \033[0m\n" << endl;
+	return true;
+}
+
+// collect corners detected before, e.g. by AutoCapture, without detecting again
+// corners1: inner corners of one camera or camera1 of DCM
+// corners2: inner corners of camera2 of DCM, default value is empty if flag = 0
+// return true if the whole chessboard is in corners of every camera and they are collected
+bool Calibrator::addCorners(const vector<cv::Point2f>& corners1,
+		const vector<cv::Point2f>& corners2)
+{
+	if((int)corners1.size() != board_n ||
+			(flag == FLAG_DOUBLE_CAMERAS && (int)corners2.size() != board_n))
+		return false;
+	imagePoints1.push_back(corners1);
+	if(flag == FLAG_DOUBLE_CAMERAS)
+		imagePoints2.push_back(corners2);
+	objectPoints.push_back(setBoardModel());
+	cout << "\033[0;32mCollected our \033[0m" << getnFrames()
+		<< "\033[0;32m of \033[0m" << n_boards
+		<< "\033[0;32m needed chessboard images \033[0m\n" << endl;
+	return true;
+}
+
+// estimate uncertainty of camera parameters from collected views in background,
+// it calibrates every camera again and keeps standard deviations of its intrinsics
+// nothing is started with fewer than 3 views, with no new view since the last estimate,
+// or while an estimate is running, so it's cheap to call after every collected view
+void Calibrator::updateUncertainty()
+{
+	int nViews = getnFrames();
+	if(nViews < 3 || nViews == nRequestedViews)
+		return;
+	{
+		lock_guard<mutex> lock(uncertaintyMutex);
+		if(estimating)
+			return;
+		estimating = true;
+	}
+	if(uncertaintyWorker.joinable())
+		uncertaintyWorker.join();
+
+	// the worker solves on copies, so views may be collected while it's running
+	nRequestedViews = nViews;
+	vector<vector<cv::Point3f> > objects = objectPoints;
+	vector<vector<cv::Point2f> > points1 = imagePoints1;
+	vector<vector<cv::Point2f> > points2 = imagePoints2;
+	uncertaintyWorker = thread([this, objects, points1, points2, nViews]()
+	{
+		cv::Mat M1, D1, M2, D2, S1, S2;
+		try
+		{
+			// a failed solve leaves no uncertainty, so the estimate never looks converged
+			if(calibrateOne(objects, points1, imageSize, M1, D1, S1, solver, nThreads) < 0)
+				S1.release();
+			if(flag == FLAG_DOUBLE_CAMERAS &&
+					calibrateOne(objects, points2, imageSize, M2, D2, S2, solver, nThreads) < 0)
+				S2.release();
+		}
+		catch(const cv::Exception&)
+		{
+			S1.release();
+			S2.release();
+		}
+
+		lock_guard<mutex> lock(uncertaintyMutex);
+		stdDevs1 = S1;
+		stdDevs2 = S2;
+		nEstimatedViews = nViews;
+		estimating = false;
+	});
+}
+
+// wait until the uncertainty estimate running in background is done
+void Calibrator::waitUncertainty()
+{
+	if(uncertaintyWorker.joinable())
+		uncertaintyWorker.join();
+}
+
+// whether standard deviations of the last estimate meet every target, for every camera
+bool Calibrator::isConverged()
+{
+	lock_guard<mutex> lock(uncertaintyMutex);
+	if(nEstimatedViews == 0)
+		return false;
+	return meetsTargets(stdDevs1) &&
+		(flag != FLAG_DOUBLE_CAMERAS || meetsTargets(stdDevs2));
+}
+
+// whether stdDevs of fx, fy, cx, cy, k1, k2, p1, p2, k3 are below focalTarget,
+// principalTarget and distortionTarget, false if they aren't estimated
+bool Calibrator::meetsTargets(const cv::Mat& stdDevs)
+{
+	if(stdDevs.total() < 9)
+		return false;
+	for(int k = 0; k < 9; k++)
+	{
+		double target = k < 2 ? focalTarget : (k < 4 ? principalTarget : distortionTarget);
+		if(stdDevs.at<double>(k) > target)
+			return false;
+	}
+	return true;
+}
+
+// print standard deviations of the last estimate, and a warning if targets aren't met
+void Calibrator::printUncertainty()
+{
+	bool converged = isConverged();
+	lock_guard<mutex> lock(uncertaintyMutex);
+	if(nEstimatedViews == 0 || stdDevs1.empty())
+		return;
+	cout << "\n\033[0;32mstandard deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3 from \033[0m"
+		<< nEstimatedViews << "\033[0;32m views\033[0m";
+	for(int camera = 0; camera < (flag == FLAG_DOUBLE_CAMERAS ? 2 : 1); camera++)
+	{
+		const cv::Mat& stdDevs = camera == 0 ? stdDevs1 : stdDevs2;
+		if(stdDevs.total() < 9)
+			continue;
+		cout << "\n\033[0;32mcamera" << camera + 1 << ": \033[0m";
+		for(int k = 0; k < 9; k++)
+			cout << stdDevs.at<double>(k) << (k < 8 ? ", " : "");
+	}
+	cout << endl;
+	if(!converged)
+	{
+		cerr << "\033[0;32mWARNING: Parameters are uncertain, capture more views "
+			<< "with different poses near image borders.\033[0m" << endl;
+	}
+}
+
+// number of frames whose corners are collected
+int Calibrator::getnFrames()
+{
+	return (int)objectPoints.size();
+}
+
+// drop all collected corners, and the uncertainty estimated from them
+void Calibrator::clearFrames()
+{
+	waitUncertainty();
+	stdDevs1.release();
+	stdDevs2.release();
+	nEstimatedViews = 0;
+	nRequestedViews = 0;
+	objectPoints.clear();
+	imagePoints1.clear();
+	imagePoints2.clear();
+	coverage.reset(imageSize, board_sz);
+}
+
+// pick nSelected collected views carrying most information about intrinsics by ViewSelector,
+// collected corners are left as they are, so the caller solves a copy of picked views
+// return indices of picked views in ascending order, all views if nSelected <= 0, if there
+// aren't more views than nSelected or if selecting fails
+vector<int> Calibrator::selectViews(int nSelected)
+{
+	int nViews = getnFrames();
+	vector<int> all(nViews);
+	for(int v = 0; v < nViews; v++)
+		all[v] = v;
+	if(nSelected <= 0 || nViews <= nSelected)
+		return all;
+
+	int64 start = cv::getTickCount();
+	ViewSelector selector(60, 1e-6, nThreads);
+	vector<int> selected = selector.select(objectPoints, imagePoints1,
+			flag == FLAG_DOUBLE_CAMERAS ? imagePoints2 : vector<vector<cv::Point2f> >(),
+			imageSize, nSelected);
+	double selectTime = (cv::getTickCount() - start) / cv::getTickFrequency();
+	if(selected.empty())
+	{
+		cerr << "\033[0;32mWARNING: No view is selected, all views are calibrated.\033[0m" << endl;
+		return all;
+	}
+	cout << "\n\033[0;32mselected views: \033[0m" << selected.size() << "\033[0;32m of \033[0m" << nViews
+		<< "\033[0;32m in \033[0m" << selectTime * 1000 << " ms"
+		<< "\033[0;32m, D-efficiency: \033[0m" << selector.getEfficiency() << endl;
+	return selected;
+}
+
+// compare intrinsics solved from nSelected views picked by selectViews() with those solved
+// from all collected views, in every camera, both assessed by reprojection errors on all views
+// it solves all views, so it's run by benchmarkSolver() only, never by calibrate()
+void Calibrator::benchmarkSelection(int nSelected)
+{
+	cout << "\n\033[0;32m********** Benchmark View Selection **********\033[0m\n";
+	vector<int> selected = selectViews(nSelected);
+	if((int)selected.size() == getnFrames())
+	{
+		cerr << "\033[0;32mERROR: No subset of \033[0m" << getnFrames()
+			<< "\033[0;32m views is selected to benchmark\033[0m" << endl;
+		return;
+	}
+
+	// setting 0 solves all views, setting 1 solves selected views, by the linear-time solver
+	// so the reference stays cheap with thousands of views
+	BundleAdjuster adjuster(nThreads);
+	for(int camera = 0; camera < (flag == FLAG_DOUBLE_CAMERAS ? 2 : 1); camera++)
+	{
+		const vector<vector<cv::Point2f> >& points = camera == 0 ? imagePoints1 : imagePoints2;
+		vector<vector<cv::Point3f> > objects;
+		vector<vector<cv::Point2f> > picked;
+		for(size_t k = 0; k < selected.size(); k++)
+		{
+			objects.push_back(objectPoints[selected[k]]);
+			picked.push_back(points[selected[k]]);
+		}
+
+		cv::Mat M[2], D[2], S[2];
+		double times[2], rms[2];
+		bool solved = true;
+		for(int setting = 0; setting < 2; setting++)
+		{
+			int64 begin = cv::getTickCount();
+			solved = adjuster.calibrate(setting == 0 ? objectPoints : objects, setting == 0 ? points : picked,
+					imageSize, M[setting], D[setting], S[setting]) >= 0 && solved;
+			times[setting] = (cv::getTickCount() - begin) / cv::getTickFrequency();
+			if(!solved)
+				break;
+			vector<double> perViewErrors;
+			rms[setting] = adjuster.reprojectionErrors(objectPoints, points, M[setting], D[setting],
+					perViewErrors);
+		}
+		if(!solved)
+		{
+			cerr << "\033[0;32mERROR: Fail to calibrate camera\033[0m" << camera + 1 << endl;
+			continue;
+		}
+
+		double focalDifference = max(fabs(M[1].at<double>(0, 0) - M[0].at<double>(0, 0)),
+				fabs(M[1].at<double>(1, 1) - M[0].at<double>(1, 1)));
+		double distortionDifference = 0;
+		for(int k = 0; k < 5; k++)
+		{
+			distortionDifference = max(distortionDifference,
+					fabs(D[1].at<double>(k) - D[0].at<double>(k)));
+		}
+		cout << "\033[0;32mcamera" << camera + 1 << " all views      solve: \033[0m" << times[0] * 1000 << " ms"
+			<< "\033[0;32m, RMS on all views: \033[0m" << rms[0] << " px";
+		cout << "\n\033[0;32mcamera" << camera + 1 << " selected views solve: \033[0m" << times[1] * 1000 << " ms"
+			<< "\033[0;32m, RMS on all views: \033[0m" << rms[1] << " px";
+		cout << "\n\033[0;32mcamera" << camera + 1 << " largest difference of focal lengths: \033[0m"
+			<< focalDifference << " px"
+			<< "\033[0;32m, of distortion coefficients: \033[0m" << distortionDifference << endl;
+	}
+}
+
+// coverage of the image and of board tilts by collected corners,
+// views collected since the last call are added to it first
+const CoverageMap& Calibrator::getCoverage()
+{
+	if(coverage.getnViews() == 0 || coverage.getnViews() > getnFrames())
+		coverage.reset(imageSize, board_sz);
+	for(int i = coverage.getnViews(); i < getnFrames(); i++)
+	{
+		if(flag == FLAG_DOUBLE_CAMERAS)
+			coverage.addView(imagePoints1[i], imagePoints2[i]);
+		else
+			coverage.addView(imagePoints1[i]);
+	}
+	return coverage;
+}
+
+// calculate camera parameters with images saved in directory
+// collected corners are replaced by corners detected on these images
+double Calibrator::calcCameraParas(string directory)
+{
+	cout << "\n\033[0;32m********** Calculate Camera(s) Parameters **********\033[0m\n";
+	waitSavedImages();
+	// corners are moved from detections into collected corners without copying,
+	// boards not found are dropped, in both cameras if flag = 1
+	clearFrames();
+	nRejected = 0;
+	string cacheFile = directory + "corners_cache.yml";
+	nCacheHits = 0;
+	if(useCornerCache)
+		loadCornerCache(cacheFile);
+	vector<cv::Point3f> boardModel = setBoardModel();
+
+	// images are saved at the native resolution of the camera, and they are calibrated
+	// at that size, use scaleCameraParas() for parameters of another resolution
+	string firstName = flag == FLAG_SINGLE_CAMERA ? imageNames[0] : imageNames1[0];
+	cv::Mat first = cv::imread(directory + firstName, cv::IMREAD_GRAYSCALE);
+	if(!first.empty() && first.size() != imageSize)
+	{
+		cout << "\033[0;32mCalibrate at image size \033[0m"
+			<< first.cols << "x" << first.rows << endl;
+		setImageSize(first.size());
+	}
+	first.release();
+	
+	// detect corners with one camera
+	if(flag == FLAG_SINGLE_CAMERA)
+	{
+		vector<BoardDetection> detections, unused;
+		if(displayMode == DISPLAY_STEP)
+			detectBoardsStepwise(directory, detections, unused);
+		else
+			detectBoards(directory, detections, unused);
+		
+		for(int i = 0; i < n_boards; i++)
+		{
+			cout << "\n\033[0;32mfindChessboardCorners state: \033[0m" << detections[i].found << endl;
+			if(!detections[i].found)
+			{
+				cout << "\033[0;32mDrop \033[0m" << imageNames[i] << endl;
+				continue;
+			}
+			imagePoints1.push_back(vector<cv::Point2f>());
+			imagePoints1.back().swap(detections[i].corners);
+			objectPoints.push_back(boardModel);
+
+			cout << "\033[0;32mCollected our \033[0m" << (int)imagePoints1.size() 
+				<< "\033[0;32m of \033[0m" << n_boards
+				<< "\033[0;32m needed chessboard images \033[0m\n" << endl;
+		}
+	}
+	
+	// detect corners with DCM
+	if(flag == FLAG_DOUBLE_CAMERAS)
+	{
+		vector<BoardDetection> detections1, detections2;
+		if(displayMode == DISPLAY_STEP)
+			detectBoardsStepwise(directory, detections1, detections2);
+		else
+			detectBoards(directory, detections1, detections2);
+		
+		for(int i = 0; i < n_boards; i++)
+		{
+			cout << "\n\033[0;32mfindChessboardCorners state (camera1): \033[0m" << detections1[i].found;
+			cout << "\n\033[0;32mfindChessboardCorners state (camera2): \033[0m" << detections2[i].found << endl;
+			if(!detections1[i].found || !detections2[i].found)
+			{
+				cout << "\033[0;32mDrop \033[0m" << imageNames1[i] << " & " << imageNames2[i] << endl;
+				continue;
+			}
+
+			imagePoints1.push_back(vector<cv::Point2f>());
+			imagePoints1.back().swap(detections1[i].corners);
+			imagePoints2.push_back(vector<cv::Point2f>());
+			imagePoints2.back().swap(detections2[i].corners);
+			objectPoints.push_back(boardModel);
+
+			cout << "\033[0;32mCollected our \033[0m" << (int)imagePoints1.size() 
+				<< "\033[0;32m of \033[0m" << n_boards
+				<< "\033[0;32m needed chessboard images \033[0m\n" << endl;
+		}
+	}
+
+	if(displayMode == DISPLAY_PREVIEW && viewer.getKey() == 27)
+		exit(0);
+	viewer.stop();
+
+	cout << "\n\033[0;32mCollected \033[0m" << getnFrames() << "\033[0;32m of \033[0m" << n_boards
+		<< "\033[0;32m boards, \033[0m" << nRejected
+		<< "\033[0;32m image(s) rejected by the fast check\033[0m" << endl;
+
+	if(useCornerCache)
+	{
+		cout << "\n\033[0;32mCorners of \033[0m" << nCacheHits
+			<< "\033[0;32m image(s) are taken from \033[0m" << cacheFile << endl;
+		saveCornerCache(cacheFile);
+	}
+
+	return calibrate();
+}
+
+// print how many corners are collected and the peak memory of this process,
+// collected corners are all that calibrate() keeps, images are never kept
+void Calibrator::printRunSummary()
+{
+	size_t nCorners = 0;
+	for(size_t i = 0; i < imagePoints1.size(); i++)
+		nCorners += imagePoints1[i].size();
+	for(size_t i = 0; i < imagePoints2.size(); i++)
+		nCorners += imagePoints2[i].size();
+	size_t cornerBytes = nCorners * (sizeof(cv::Point2f) + sizeof(cv::Point3f));
+
+	cout << "\n\033[0;32m---------------- run summary ---------------\033[0m\n";
+	cout << "\033[0;32mcollected views: \033[0m" << getnFrames();
+	cout << "\n\033[0;32mcollected corners: \033[0m" << nCorners
+		<< " (" << cornerBytes / 1024.0 << " KB)";
+	const CoverageMap& covered = getCoverage();
+	cout << "\n\033[0;32mcovered cells: \033[0m" << (int)(covered.getCellCoverage(0) * 100 + 0.5) << "%";
+	if(flag == FLAG_DOUBLE_CAMERAS)
+		cout << " / " << (int)(covered.getCellCoverage(1) * 100 + 0.5) << "%";
+	cout << "\033[0;32m, filled tilt bins: \033[0m" << covered.getnPoseBins() << "/9";
+	cout << "\n\033[0;32mpeak memory (RSS): \033[0m" << peakMemoryMB() << " MB" << endl;
+}
+
+// solve views by the solver, both cameras of a DCM and R, T by stereoMode,
+// it exits if BundleAdjuster fails
+// objects, points1, points2: board model and corners of every solved view, points2 with DCM only
+// useGuess: start from the current parameters, as a re-solve after dropping views does
+void Calibrator::solveCameras(const vector<vector<cv::Point3f> >& objects,
+		const vector<vector<cv::Point2f> >& points1, const vector<vector<cv::Point2f> >& points2,
+		bool useGuess)
+{
+	// calculate camera parameters with one camera
+	if(flag == FLAG_SINGLE_CAMERA)
+	{
+		int64 start = cv::getTickCount();
+		double rms = calibrateOne(objects, points1, imageSize, cameraMatrix1, distCoeffs1,
+				stdDevs1, solver, nThreads, useGuess);
+		if(rms < 0)
+		{
+			cerr << "\033[0;32mERROR: Fail to calibrate camera1.\033[0m" << endl;
+			exit(0);
+		}
+		cout << "\n\033[0;32mSolved camera1 in \033[0m"
+			<< (cv::getTickCount() - start) * 1000 / cv::getTickFrequency() << " ms"
+			<< "\033[0;32m, RMS: \033[0m" << rms << " px" << endl;
+		return;
+	}
+	
+	// calculate camera parameters with DCM in one optimization
+	if(stereoMode == STEREO_JOINT)
+	{
+		int64 start = cv::getTickCount();
+		BundleAdjuster adjuster(nThreads);
+		cv::Mat E;
+		double rms = adjuster.calibrateStereo(objects, points1, points2, imageSize,
+				cameraMatrix1, distCoeffs1, cameraMatrix2, distCoeffs2, R, T, E, F,
+				stdDevs1, stdDevs2, useGuess);
+		if(rms < 0)
+		{
+			cerr << "\033[0;32mERROR: Fail to calibrate camera1 and camera2 jointly.\033[0m" << endl;
+			exit(0);
+		}
+		cout << "\n\033[0;32mSolved camera1, camera2, R and T jointly in \033[0m"
+			<< (cv::getTickCount() - start) * 1000 / cv::getTickFrequency() << " ms"
+			<< "\033[0;32m, RMS: \033[0m" << rms << " px" << endl;
+		return;
+	}
+
+	// calculate camera parameters with DCM
+	// both cameras are independent before stereoCalibrate, so camera2 is solved
+	// on another thread while camera1 is solved on this one
+	int64 start = cv::getTickCount();
+	double rms1 = 0, rms2 = 0;
+	exception_ptr failure;
+	thread solve2([&]()
+	{
+		try
+		{
+			rms2 = calibrateOne(objects, points2, imageSize,
+					cameraMatrix2, distCoeffs2, stdDevs2, solver, nThreads, useGuess);
+		}
+		catch(...)
+		{
+			failure = current_exception();
+		}
+	});
+	try
+	{
+		rms1 = calibrateOne(objects, points1, imageSize,
+				cameraMatrix1, distCoeffs1, stdDevs1, solver, nThreads, useGuess);
+	}
+	catch(...)
+	{
+		solve2.join();
+		throw;
+	}
+	solve2.join();
+	if(failure)
+		rethrow_exception(failure);
+	if(rms1 < 0 || rms2 < 0)
+	{
+		cerr << "\033[0;32mERROR: Fail to calibrate camera1 and camera2.\033[0m" << endl;
+		exit(0);
+	}
+	cout << "\n\033[0;32mSolved camera1 and camera2 concurrently in \033[0m"
+		<< (cv::getTickCount() - start) * 1000 / cv::getTickFrequency() << " ms"
+		<< "\033[0;32m, RMS: \033[0m" << rms1 << " / " << rms2 << " px" << endl;
+
+	cv::Mat E;
+	double stereoRms = cv::stereoCalibrate(objects,
+		points1, points2,
+		cameraMatrix1, distCoeffs1,
+		cameraMatrix2, distCoeffs2,
+		imageSize, R, T, E, F, cv::CALIB_FIX_INTRINSIC,
+		cv::TermCriteria(CV_TERMCRIT_ITER+CV_TERMCRIT_EPS, 100, 1e-5));
+	cout << "\033[0;32mSolved R and T, stereo RMS: \033[0m" << stereoRms << " px" << endl;
+}
+
+// reprojection errors of every solved view at the calibrated intrinsics, into viewErrors,
+// every camera of a view is posed on its own by BundleAdjuster::reprojectionErrors(),
+// so errors are measured the same way whichever solver calibrated the cameras
+// objects, points1, points2: board model and corners of every solved view, as solveCameras()
+// views: index in viewErrors of every solved view
+void Calibrator::measureViewErrors(const vector<vector<cv::Point3f> >& objects,
+		const vector<vector<cv::Point2f> >& points1, const vector<vector<cv::Point2f> >& points2,
+		const vector<int>& views)
+{
+	BundleAdjuster adjuster(nThreads);
+	for(int camera = 0; camera < (flag == FLAG_DOUBLE_CAMERAS ? 2 : 1); camera++)
+	{
+		vector<double> perViewErrors;
+		vector<vector<float> > perCornerErrors;
+		double rms = adjuster.reprojectionErrors(objects, camera == 0 ? points1 : points2,
+				camera == 0 ? cameraMatrix1 : cameraMatrix2, camera == 0 ? distCoeffs1 : distCoeffs2,
+				perViewErrors, &perCornerErrors);
+		(camera == 0 ? rmsError1 : rmsError2) = rms;
+		for(size_t v = 0; v < views.size(); v++)
+		{
+			ViewError& error = viewErrors[views[v]];
+			(camera == 0 ? error.rms1 : error.rms2) = perViewErrors[v];
+			(camera == 0 ? error.errors1 : error.errors2).swap(perCornerErrors[v]);
+		}
+	}
+}
+
+// collected views whose RMS error exceeds median + outlierSigma * 1.4826 * MAD of any camera,
+// 1.4826 * MAD being the standard deviation of normal errors, robust to the outliers
+// themselves, views not posed are outliers too
+// views: index in viewErrors of every collected view
+// nDroppable: most views to return, the worst views relative to thresholds first
+// return positions of outliers among collected views in ascending order
+vector<int> Calibrator::findOutliers(const vector<int>& views, int nDroppable)
+{
+	int nViews = (int)views.size();
+	vector<double> scores(nViews, 0.0);
+	for(int camera = 0; camera < (flag == FLAG_DOUBLE_CAMERAS ? 2 : 1); camera++)
+	{
+		vector<double> errors;
+		for(int v = 0; v < nViews; v++)
+		{
+			double rms = camera == 0 ? viewErrors[views[v]].rms1 : viewErrors[views[v]].rms2;
+			if(rms >= 0)
+				errors.push_back(rms);
+		}
+		if(errors.empty())
+			continue;
+		nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+		double median = errors[errors.size() / 2];
+		for(size_t k = 0; k < errors.size(); k++)
+			errors[k] = fabs(errors[k] - median);
+		nth_element(errors.begin(), errors.begin() + errors.size() / 2, errors.end());
+		// a floor of 0.001 px keeps views of nearly identical errors when MAD is 0
+		double threshold = median + outlierSigma * max(1.4826 * errors[errors.size() / 2], 0.001);
+		for(int v = 0; v < nViews; v++)
+		{
+			double rms = camera == 0 ? viewErrors[views[v]].rms1 : viewErrors[views[v]].rms2;
+			scores[v] = max(scores[v], rms < 0 ? HUGE_VAL : rms / threshold);
+		}
+	}
+
+	vector<int> outliers;
+	for(int v = 0; v < nViews; v++)
+	{
+		if(scores[v] > 1)
+			outliers.push_back(v);
+	}
+	if((int)outliers.size() > nDroppable)
+	{
+		sort(outliers.begin(), outliers.end(), [&](int a, int b) { return scores[a] > scores[b]; });
+		outliers.resize(max(nDroppable, 0));
+	}
+	sort(outliers.begin(), outliers.end());
+	return outliers;
+}
+
+// print RMS errors of every camera, views dropped as outliers and the worst views
+void Calibrator::printErrorReport()
+{
+	bool dcm = flag == FLAG_DOUBLE_CAMERAS;
+	int nDropped = 0;
+	vector<int> order;
+	for(size_t i = 0; i < viewErrors.size(); i++)
+	{
+		if(viewErrors[i].round > 0)
+			nDropped++;
+		order.push_back((int)i);
+	}
+	auto worst = [&](const ViewError& error) { return max(error.rms1, dcm ? error.rms2 : -1.0); };
+	sort(order.begin(), order.end(), [&](int a, int b)
+	{
+		return worst(viewErrors[a]) > worst(viewErrors[b]);
+	});
+
+	cout << "\n\033[0;32m-------------- reprojection errors --------------\033[0m\n";
+	cout << "\033[0;32mRMS of kept views: \033[0m" << rmsError1;
+	if(dcm)
+		cout << " / " << rmsError2;
+	cout << " px\033[0;32m, dropped views: \033[0m" << nDropped << "\033[0;32m of \033[0m" << viewErrors.size();
+	for(size_t k = 0; k < order.size() && k < 10; k++)
+	{
+		const ViewError& error = viewErrors[order[k]];
+		cout << "\n\033[0;32mview \033[0m" << error.view << ": " << error.rms1;
+		if(dcm)
+			cout << " / " << error.rms2;
+		cout << " px";
+		if(error.round > 0)
+			cout << "\033[0;32m, dropped in round \033[0m" << error.round;
+	}
+	cout << endl;
+}
+
+// store viewErrors next to filename, as <name>_errors.<extension>, with the image size errors are
+// measured at, RMS errors of every camera, the rejection round and the error of every corner of every view
+void Calibrator::saveErrorReport()
+{
+	if(viewErrors.empty())
+		return;
+	size_t dot = filename.find_last_of('.');
+	size_t slash = filename.find_last_of("/\\");
+	if(dot == string::npos || (slash != string::npos && dot < slash))
+		dot = filename.size();
+	string reportName = filename.substr(0, dot) + "_errors" + filename.substr(dot);
+	cout << "\033[0;32mStoring reprojection errors in \033[0m" << reportName << endl;
+
+	bool dcm = flag == FLAG_DOUBLE_CAMERAS;
+	cv::FileStorage fs(reportName, cv::FileStorage::WRITE);
+	// errors are pixels of the image size they are measured at, which differs from image size
+	// of saved parameters after scaleCameraParas()
+	fs << "image_width" << errorImageSize.width
+		<< "image_height" << errorImageSize.height;
+	fs << "rms_camera1" << rmsError1;
+	if(dcm)
+		fs << "rms_camera2" << rmsError2;
+	fs << "outlier_sigma" << outlierSigma;
+	if(heldOutError >= 0)
+		fs << "folds" << nFolds << "held_out_rms" << heldOutError;
+	fs << "views" << "[";
+	for(size_t i = 0; i < viewErrors.size(); i++)
+	{
+		const ViewError& error = viewErrors[i];
+		fs << "{" << "view" << error.view
+			<< "rejected_round" << error.round
+			<< "rms_camera1" << error.rms1
+			<< "errors_camera1" << error.errors1;
+		if(dcm)
+			fs << "rms_camera2" << error.rms2 << "errors_camera2" << error.errors2;
+		fs << "}";
+	}
+	fs << "]";
+	fs.release();
+}
+
+// calculate camera parameters with collected corners, from addFrame() or calcCameraParas()
+// with outlierSigma > 0, views far above the median reprojection error are dropped and
+// the rest are solved again from the last parameters, for at most 5 rounds, keeping at
+// least half of views
+// with nFolds > 0, kept views are cross validated by crossValidate() at last
+// return the average error of assessError() if flag = 1, otherwise the RMS reprojection error
+double Calibrator::calibrate()
+{
+	waitUncertainty();
+	printRunSummary();
+	if(getnFrames() == 0)
+	{
+		cerr << "\033[0;32mERROR: No chessboard is collected to calibrate.\033[0m" << endl;
+		exit(0);
+	}
+	// selected views are solved from working copies, outliers are dropped from them only,
+	// so collected corners stay complete for saveCorners()
+	vector<int> selected = selectViews(nSelectedViews);
+	int nViews = (int)selected.size();
+	vector<vector<cv::Point3f> > objects;
+	vector<vector<cv::Point2f> > points1, points2;
+	for(int v = 0; v < nViews; v++)
+	{
+		objects.push_back(objectPoints[selected[v]]);
+		points1.push_back(imagePoints1[selected[v]]);
+		if(flag == FLAG_DOUBLE_CAMERAS)
+			points2.push_back(imagePoints2[selected[v]]);
+	}
+	vector<int> views(nViews);
+	viewErrors.assign(nViews, ViewError());
+	errorImageSize = imageSize;
+	for(int v = 0; v < nViews; v++)
+	{
+		views[v] = v;
+		viewErrors[v].view = selected[v];
+	}
+	solveCameras(objects, points1, points2, false);
+	measureViewErrors(objects, points1, points2, views);
+
+	int nKept = max(3, (nViews + 1) / 2);
+	for(int round = 1; outlierSigma > 0 && round <= 5; round++)
+	{
+		vector<int> outliers = findOutliers(views, (int)views.size() - nKept);
+		if(outliers.empty())
+			break;
+
+		// outliers are ascending, so erasing from the last one keeps positions of the others
+		for(int k = (int)outliers.size() - 1; k >= 0; k--)
+		{
+			int v = outliers[k];
+			viewErrors[views[v]].round = round;
+			views.erase(views.begin() + v);
+			objects.erase(objects.begin() + v);
+			points1.erase(points1.begin() + v);
+			if(flag == FLAG_DOUBLE_CAMERAS)
+				points2.erase(points2.begin() + v);
+		}
+		cout << "\n\033[0;32mRound \033[0m" << round << "\033[0;32m drops \033[0m" << outliers.size()
+			<< "\033[0;32m outlier view(s), solving \033[0m" << views.size() << "\033[0;32m views again\033[0m";
+		solveCameras(objects, points1, points2, true);
+		measureViewErrors(objects, points1, points2, views);
+	}
+	nEstimatedViews = (int)views.size();
+	printErrorReport();
+	printUncertainty();
+	if(nFolds > 0)
+		crossValidate(objects, points1, points2, nFolds);
+
+	if(flag == FLAG_DOUBLE_CAMERAS)
+		return assessError(points1, points2);
+	return rmsError1;
+}
+
+// K-fold cross-validation of collected views, views are split into nFolds contiguous blocks,
+// every block is held out once while the others are solved, and the held-out views are
+// assessed by BundleAdjuster::reprojectionErrors() at the intrinsics of the other views.
+// Contiguous blocks keep consecutive near duplicate frames in the same fold, so held-out
+// errors measure how intrinsics generalize to poses that aren't solved. Folds are solved
+// concurrently, one fold per thread, every solve on a single thread, OpenCV's thread pool
+// included. A fold failing in any way is reported as unsolved.
+// A DCM is validated camera by camera, jointly with STEREO_JOINT, but R and T aren't
+// assessed on held-out views.
+// return the RMS error of all held-out corners of the worse camera, -1 if it can't run
+double Calibrator::crossValidate(int nFolds)
 {
-	stringstream ss;
-	if(flag == FLAG_SINGLE_CAMERA)
+	return crossValidate(objectPoints, imagePoints1, imagePoints2, nFolds);
+}
+
+// cross-validation of given views, as calibrate() runs it on views kept after rejecting outliers
+// objects, points1, points2: board model and corners of every view, points2 with DCM only
+double Calibrator::crossValidate(const vector<vector<cv::Point3f> >& objects,
+		const vector<vector<cv::Point2f> >& points1, const vector<vector<cv::Point2f> >& points2,
+		int nFolds)
+{
+	cout << "\n\033[0;32m********** Cross Validation **********\033[0m\n";
+	int nViews = (int)objects.size();
+	int nCameras = flag == FLAG_DOUBLE_CAMERAS ? 2 : 1;
+	heldOutError = -1;
+	if(nFolds < 2 || nViews - (nViews + nFolds - 1) / nFolds < 3)
 	{
-		imageNames = new string[n_boards];  
-		for(int i = 0; i < n_boards; i++)
+		cerr << "\033[0;32mERROR: Cross validation needs at least 2 folds and 3 views to solve "
+			<< "in every fold, there are \033[0m" << nFolds << "\033[0;32m folds of \033[0m" << nViews
+			<< "\033[0;32m views\033[0m" << endl;
+		return -1;
+	}
+
+	// results of every fold, every camera
+	vector<cv::Mat> M[2], D[2];
+	vector<double> trainErrors[2], heldOutErrors[2], heldOutCosts[2], times(nFolds, 0.0);
+	vector<int> heldOutPoints[2];
+	for(int camera = 0; camera < nCameras; camera++)
+	{
+		M[camera].assign(nFolds, cv::Mat());
+		D[camera].assign(nFolds, cv::Mat());
+		trainErrors[camera].assign(nFolds, -1.0);
+		heldOutErrors[camera].assign(nFolds, -1.0);
+		heldOutCosts[camera].assign(nFolds, 0.0);
+		heldOutPoints[camera].assign(nFolds, 0);
+	}
+
+	auto solveFold = [&](int fold)
+	{
+		int64 start = cv::getTickCount();
+		try
 		{
-			ss.str("");  // clear ss
-			if(i < 9)
+			int begin = (int)((long long)fold * nViews / nFolds);
+			int end = (int)((long long)(fold + 1) * nViews / nFolds);
+			vector<vector<cv::Point3f> > trainObjects, testObjects;
+			vector<vector<cv::Point2f> > trainPoints[2], testPoints[2];
+			for(int v = 0; v < nViews; v++)
 			{
-				ss << "img_0" << (i + 1) << ".jpg";
-				imageNames[i] = ss.str();
+				bool heldOut = v >= begin && v < end;
+				(heldOut ? testObjects : trainObjects).push_back(objects[v]);
+				(heldOut ? testPoints[0] : trainPoints[0]).push_back(points1[v]);
+				if(nCameras == 2)
+					(heldOut ? testPoints[1] : trainPoints[1]).push_back(points2[v]);
+			}
+
+			cv::Mat S[2];
+			if(nCameras == 2 && stereoMode == STEREO_JOINT)
+			{
+				BundleAdjuster adjuster(1);
+				cv::Mat Rf, Tf, Ef, Ff;
+				double rms = adjuster.calibrateStereo(trainObjects, trainPoints[0], trainPoints[1],
+						imageSize, M[0][fold], D[0][fold], M[1][fold], D[1][fold], Rf, Tf, Ef, Ff, S[0], S[1]);
+				trainErrors[0][fold] = trainErrors[1][fold] = rms;
 			}
 			else
 			{
-				ss << "img_" << (i + 1) << ".jpg";
-				imageNames[i] = ss.str();
+				for(int camera = 0; camera < nCameras; camera++)
+				{
+					trainErrors[camera][fold] = calibrateOne(trainObjects, trainPoints[camera], imageSize,
+							M[camera][fold], D[camera][fold], S[camera], solver, 1);
+				}
+			}
+
+			for(int camera = 0; camera < nCameras; camera++)
+			{
+				if(trainErrors[camera][fold] < 0)
+					continue;
+				BundleAdjuster adjuster(1);
+				vector<double> perViewErrors;
+				heldOutErrors[camera][fold] = adjuster.reprojectionErrors(testObjects, testPoints[camera],
+						M[camera][fold], D[camera][fold], perViewErrors);
+				for(size_t v = 0; v < perViewErrors.size(); v++)
+				{
+					if(perViewErrors[v] < 0)
+						continue;
+					int n = (int)testPoints[camera][v].size();
+					heldOutCosts[camera][fold] += perViewErrors[v] * perViewErrors[v] * n;
+					heldOutPoints[camera][fold] += n;
+				}
+			}
+		}
+		catch(...)
+		{
+			// any failure of a fold, e.g. cv::Exception or bad_alloc, only drops that fold
+			for(int camera = 0; camera < nCameras; camera++)
+			{
+				trainErrors[camera][fold] = -1;
+				heldOutErrors[camera][fold] = -1;
+				heldOutCosts[camera][fold] = 0;
+				heldOutPoints[camera][fold] = 0;
 			}
 		}
+		times[fold] = (cv::getTickCount() - start) / cv::getTickFrequency();
+	};
+
+	// workers take folds one by one, so a slow fold doesn't hold others back
+	int threads = nThreads > 0 ? nThreads : (int)thread::hardware_concurrency();
+	if(threads > nFolds)
+		threads = nFolds;
+	if(threads < 1)
+		threads = 1;
+	// calibrateCamera() would run on OpenCV's own thread pool inside every fold thread,
+	// so OpenCV is kept to one thread while folds run and restored afterwards
+	int cvThreads = cv::getNumThreads();
+	if(threads > 1)
+		cv::setNumThreads(1);
+	int64 start = cv::getTickCount();
+	atomic<int> nextFold(0);
+	vector<thread> workers;
+	for(int t = 0; t < threads; t++)
+	{
+		workers.push_back(thread([&]()
+		{
+			for(int fold = nextFold++; fold < nFolds; fold = nextFold++)
+				solveFold(fold);
+		}));
+	}
+	for(size_t t = 0; t < workers.size(); t++)
+		workers[t].join();
+	if(threads > 1)
+		cv::setNumThreads(cvThreads);
+	double wallTime = (cv::getTickCount() - start) / cv::getTickFrequency();
+	double serialTime = 0;
+	for(int fold = 0; fold < nFolds; fold++)
+		serialTime += times[fold];
+
+	cout << "\033[0;32mviews: \033[0m" << nViews << "\033[0;32m, folds: \033[0m" << nFolds
+		<< "\033[0;32m, threads: \033[0m" << threads
+		<< "\033[0;32m, time: \033[0m" << wallTime * 1000 << " ms"
+		<< "\033[0;32m (\033[0m" << serialTime * 1000 << " ms\033[0;32m of folds)\033[0m";
+	for(int fold = 0; fold < nFolds; fold++)
+	{
+		cout << "\n\033[0;32mfold \033[0m" << fold + 1 << "\033[0;32m, views \033[0m"
+			<< (long long)fold * nViews / nFolds << "-" << (long long)(fold + 1) * nViews / nFolds - 1
+			<< "\033[0;32m, RMS solved / held out: \033[0m";
+		for(int camera = 0; camera < nCameras; camera++)
+		{
+			cout << (camera > 0 ? ", " : "") << trainErrors[camera][fold]
+				<< " / " << heldOutErrors[camera][fold];
+		}
+		cout << " px";
 	}
 
-	if(flag == FLAG_DOUBLE_CAMERAS)
+	// spread of intrinsics over folds, with the standard deviation of every parameter
+	const char* names[7] = {"fx", "fy", "k1", "k2", "p1", "p2", "k3"};
+	for(int camera = 0; camera < nCameras; camera++)
 	{
-		imageNames1 = new string[n_boards];
-		imageNames2 = new string[n_boards];
-		for(int i = 0; i < n_boards; i++)
+		double cost = 0;
+		int nPoints = 0, nSolved = 0;
+		double sum[7] = {0}, sum2[7] = {0};
+		for(int fold = 0; fold < nFolds; fold++)
 		{
-			ss.str("");
-			if(i < 9)
-			{
-				ss << "img1_0" << (i + 1) << ".jpg";
-				imageNames1[i] = ss.str();
-				ss.str("");
-				ss << "img2_0" << (i + 1) << ".jpg";
-				imageNames2[i] = ss.str();
-			}
-			else
+			cost += heldOutCosts[camera][fold];
+			nPoints += heldOutPoints[camera][fold];
+			if(trainErrors[camera][fold] < 0)
+				continue;
+			cv::Mat M64, D64;
+			M[camera][fold].convertTo(M64, CV_64F);
+			D[camera][fold].convertTo(D64, CV_64F);
+			for(int k = 0; k < 7; k++)
 			{
-				ss << "img1_" << (i + 1) << ".jpg";
-				imageNames1[i] = ss.str();
-				ss.str("");
-				ss << "img2_" << (i + 1) << ".jpg";
-				imageNames2[i] = ss.str();
+				double value = k == 0 ? M64.at<double>(0, 0) : (k == 1 ? M64.at<double>(1, 1) :
+						(k - 2 < (int)D64.total() ? D64.at<double>(k - 2) : 0));
+				sum[k] += value;
+				sum2[k] += value * value;
 			}
+			nSolved++;
+		}
+		double rms = nPoints > 0 ? sqrt(cost / nPoints) : -1;
+		heldOutError = max(heldOutError, rms);
+		cout << "\n\033[0;32mcamera" << camera + 1 << " held-out RMS: \033[0m" << rms << " px"
+			<< "\033[0;32m, solved folds: \033[0m" << nSolved << "/" << nFolds;
+		if(nSolved == 0)
+			continue;
+		cout << "\n\033[0;32mcamera" << camera + 1 << " mean (std) over folds:\033[0m";
+		for(int k = 0; k < 7; k++)
+		{
+			double mean = sum[k] / nSolved;
+			double deviation = sqrt(max(sum2[k] / nSolved - mean * mean, 0.0));
+			cout << " " << names[k] << " " << mean << " (" << deviation << ")";
 		}
 	}
-	ss.clear();
+	cout << endl;
+	return heldOutError;
 }
 
-// save framenumber-th images into indicated directory
-// image names comes from imageNames if flag = 0 
-// or imageNames1 and imageNames2 if flag = 1 
-// frame1: captured images by one camera or camera1 of DCM
-// frame2: captured images by camera2 of DCM, default value is cv::Mat() if flag = 0
-void Calibrator::saveImages(int frameNumber, string directory,
-		cv::Mat frame1, cv::Mat frame2)
+// save collected corners into cornerFile, a compact binary file for loadCorners()
+// layout in native byte order:
+//   "CALC", int32 version, int32 flag, int32 imageWidth, int32 imageHeight,
+//   int32 board_w, int32 board_h, float32 squareWidth, int32 number of views,
+//   then for every view: int32 n, n objectPoints (x, y, z), n imagePoints1 (x, y),
+//   and n imagePoints2 (x, y) if flag = 1
+// return true if all corners are written
+bool Calibrator::saveCorners(string cornerFile)
 {
-	cout << "\033[0;32mContinue capturing pictures\033[0m\n";
-	cout << "\033[0;32mSave \033[0m" << (frameNumber + 1) << " \033[0;32mpicture(s).\033[0m\n\n";
+	// every view needs as many image points in each camera as object points,
+	// checked before the file is opened, so an existing file isn't truncated
+	bool doubleCameras = flag == FLAG_DOUBLE_CAMERAS;
+	bool consistent = imagePoints1.size() == objectPoints.size() &&
+		(!doubleCameras || imagePoints2.size() == objectPoints.size());
+	for(size_t i = 0; consistent && i < objectPoints.size(); i++)
+		consistent = imagePoints1[i].size() == objectPoints[i].size() &&
+			(!doubleCameras || imagePoints2[i].size() == objectPoints[i].size());
+	if(!consistent)
+	{
+		cerr << "\033[0;32mERROR: Object and image points of collected views don't match, "
+			<< "corners aren't saved in\033[0m " << cornerFile << endl;
+		return false;
+	}
 
-	if(flag == FLAG_SINGLE_CAMERA)
-		cv::imwrite(directory + imageNames[frameNumber], frame1);
+	ofstream file(cornerFile.c_str(), ios::binary);
+	if(!file)
+	{
+		cerr << "\033[0;32mERROR: Fail to open\033[0m " << cornerFile << endl;
+		return false;
+	}
 
-	if(flag == FLAG_DOUBLE_CAMERAS)
+	int32_t header[] = {CORNER_FILE_VERSION, flag, imageWidth, imageHeight,
+		board_w, board_h};
+	int32_t nViews = (int32_t)objectPoints.size();
+	file.write("CALC", 4);
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)&squareWidth, sizeof(squareWidth));
+	file.write((const char*)&nViews, sizeof(nViews));
+	for(int i = 0; i < nViews; i++)
 	{
-		cv::imwrite(directory + imageNames1[frameNumber], frame1);
-		cv::imwrite(directory + imageNames2[frameNumber], frame2);
+		int32_t n = (int32_t)objectPoints[i].size();
+		file.write((const char*)&n, sizeof(n));
+		file.write((const char*)objectPoints[i].data(), n * sizeof(cv::Point3f));
+		file.write((const char*)imagePoints1[i].data(), n * sizeof(cv::Point2f));
+		if(doubleCameras)
+			file.write((const char*)imagePoints2[i].data(), n * sizeof(cv::Point2f));
 	}
-}
 
-// store cordinates or inner corners in a vector<cv::Point3f>
-vector<cv::Point3f> Calibrator::setBoardModel()
-{
-	vector<cv::Point3f> opts;
-	opts.resize(board_n);
-	for(int j = 0; j < board_n; j++)
+	if(!file)
 	{
-		opts[j] = cv::Point3f((float)(j / board_w * squareWidth),
-				(float)((j % board_w) * squareWidth), 0.f);
+		cerr << "\033[0;32mERROR: Fail to write\033[0m " << cornerFile << endl;
+		return false;
 	}
-	return opts;
+	cout << "\n\033[0;32mSaved corners of \033[0m" << nViews
+		<< "\033[0;32m view(s) in \033[0m" << cornerFile << endl;
+	return true;
 }
 
-// store camera parameters into filename(.xml or .yml) after calibrating
-// please notice names of variables in the file 
-// avgError: the average distance between points in one image and epiline in another image
-//           its default value is 0.
-void Calibrator::saveCameraParas(double avgError)
+// load corners saved by saveCorners() from cornerFile, so that calibrate() runs without any image
+// collected corners, flag, image size and chessboard are replaced by those in cornerFile
+// return true if cornerFile is loaded
+bool Calibrator::loadCorners(string cornerFile)
 {
-	this->filename = filename;
-	cout << "\n\033[0;32mStoring calibrated parameters in \033[0m" << filename << endl;
-	cv::FileStorage fs(filename, cv::FileStorage::WRITE);
+	ifstream file(cornerFile.c_str(), ios::binary);
+	char magic[4] = {0};
+	int32_t header[6] = {0};
+	float width = 0.f;
+	int32_t nViews = 0;
+	file.read(magic, 4);
+	file.read((char*)header, sizeof(header));
+	file.read((char*)&width, sizeof(width));
+	file.read((char*)&nViews, sizeof(nViews));
+	if(!file || string(magic, 4) != "CALC" || header[0] != CORNER_FILE_VERSION || nViews < 0)
+	{
+		cerr << "\033[0;32mERROR: Fail to load corners from\033[0m " << cornerFile << endl;
+		return false;
+	}
+	// the header is checked before anything is replaced, a corrupt file leaves this Calibrator as it is
+	if((header[1] != FLAG_SINGLE_CAMERA && header[1] != FLAG_DOUBLE_CAMERAS) ||
+			header[2] <= 0 || header[3] <= 0 || header[4] <= 0 || header[5] <= 0 ||
+			header[4] > 1000 || header[5] > 1000 || !(width > 0))
+	{
+		cerr << "\033[0;32mERROR: Invalid header of corner file\033[0m " << cornerFile << endl;
+		return false;
+	}
 
-	if(flag == FLAG_SINGLE_CAMERA)
+	setCalibParas(header[2], header[3], header[4], header[5], n_boards,
+			width, filename, header[1]);
+	clearFrames();
+	bool valid = true;
+	for(int i = 0; i < nViews; i++)
 	{
-		fs << "image_width" << imageWidth
-			<< "image_height" << imageHeight
-			<< "camera_matrix" << cameraMatrix1
-			<< "distortion_coefficients" << distCoeffs1;
+		// every view has all inner corners of the chessboard, any other count means a corrupt file
+		int32_t n = 0;
+		file.read((char*)&n, sizeof(n));
+		if(!file)
+			break;
+		if(n != board_w * board_h)
+		{
+			valid = false;
+			break;
+		}
+		objectPoints.push_back(vector<cv::Point3f>(n));
+		imagePoints1.push_back(vector<cv::Point2f>(n));
+		file.read((char*)objectPoints.back().data(), n * sizeof(cv::Point3f));
+		file.read((char*)imagePoints1.back().data(), n * sizeof(cv::Point2f));
+		if(flag == FLAG_DOUBLE_CAMERAS)
+		{
+			imagePoints2.push_back(vector<cv::Point2f>(n));
+			file.read((char*)imagePoints2.back().data(), n * sizeof(cv::Point2f));
+		}
 	}
-	
-	if(flag == FLAG_DOUBLE_CAMERAS)
+
+	if(!file || !valid)
 	{
-		fs << "camera1_width" << imageWidth
-			<< "camera1_height" << imageHeight
-			<< "camera1_intrinsics" << cameraMatrix1
-			<< "camera1_distortion_coeffs" << distCoeffs1
-			<< "camera2_width" << imageWidth
-			<< "camera2_height" << imageHeight
-			<< "camera2_intrinsics" << cameraMatrix2
-			<< "camera2_distortion_coeffs" << distCoeffs2
-			<< "camera2_to_camera1_rotation" << R
-			<< "camera2_to_camera1_translation" << T
-			<< "assess_error" << avgError;
+		cerr << "\033[0;32mERROR: " << (valid ? "Truncated" : "Corrupt") << " corner file\033[0m "
+			<< cornerFile << endl;
+		clearFrames();
+		return false;
 	}
-	fs.release();
+	cout << "\n\033[0;32mLoaded corners of \033[0m" << nViews
+		<< "\033[0;32m view(s) from \033[0m" << cornerFile << endl;
+	return true;
 }
 
-// calculate camera parameters
-double Calibrator::calcCameraParas(string directory)
+// compare configured detection (e.g. detector, refiner, pyramidWidth, fastReject) with
+// reference detection, which finds corners by findChessboardCorners() and refines them
+// by cornerSubPix() on the full image without any check first, on images saved in directory
+// it prints detecting latency of both, and distances between their corners,
+// then it compares both refining kernels alone on the same corners found by the reference,
+// and checks SubPixRefiner refines every corner independently of a corner leaving its patch
+void Calibrator::benchmarkDetection(string directory)
 {
-	cout << "\n\033[0;32m********** Calculate Camera(s) Parameters **********\033[0m\n";
-	vector<vector<cv::Point3f> > objectPoints;	
-	vector<cv::Point3f> boardModel = setBoardModel();
-	
-	// calculate camera parameters with one camera
-	if(flag == FLAG_SINGLE_CAMERA)
+	cout << "\n\033[0;32m********** Benchmark Detection **********\033[0m\n";
+	waitSavedImages();
+
+	vector<string> paths;
+	for(int i = 0; i < n_boards; i++)
 	{
-		cv::Mat image;
-		vector<vector<cv::Point2f> > imagePoints;
-		
-		for(int i = 0; i < n_boards; i++)
+		if(flag == FLAG_SINGLE_CAMERA)
+			paths.push_back(directory + imageNames[i]);
+		if(flag == FLAG_DOUBLE_CAMERAS)
 		{
-			image = cv::imread(directory + imageNames[i], -1);
-			vector<cv::Point2f> corners;
+			paths.push_back(directory + imageNames1[i]);
+			paths.push_back(directory + imageNames2[i]);
+		}
+	}
 
-			bool found = cv::findChessboardCorners(image, board_sz, corners);
-			cout << "\n\033[0;32mfindChessboardCorners state: \033[0m" << found << endl;
-			if(image.channels() != 1)
+	int engine = detector;
+	int kernel = refiner;
+	int pyramid = pyramidWidth;
+	bool reject = fastReject;
+	int nFound[2] = {0, 0};
+	double times[2] = {0, 0};
+	double sumDistance = 0, maxDistance = 0;
+	int nCompared = 0, nImages = 0;
+	double refineTimes[2] = {0, 0};
+	double sumRefineDistance = 0, maxRefineDistance = 0;
+	double maxIsolationDistance = 0;
+	int nRefined = 0;
+	for(size_t k = 0; k < paths.size(); k++)
+	{
+		cv::Mat image = cv::imread(paths[k], cv::IMREAD_GRAYSCALE);
+		if(image.empty())
+			continue;
+		nImages++;
+
+		// setting 0 is reference detection, setting 1 is configured detection
+		vector<cv::Point2f> corners[2];
+		bool found[2];
+		for(int setting = 0; setting < 2; setting++)
+		{
+			detector = setting == 0 ? DETECTOR_OPENCV : engine;
+			refiner = setting == 0 ? SUBPIX_OPENCV : kernel;
+			pyramidWidth = setting == 0 ? 0 : pyramid;
+			fastReject = setting == 0 ? false : reject;
+
+			cv::Mat copy = image.clone();
+			int64 start = cv::getTickCount();
+			found[setting] = detectCorners(copy, corners[setting]);
+			times[setting] += (cv::getTickCount() - start) / cv::getTickFrequency();
+			nFound[setting] += found[setting];
+		}
+		detector = engine;
+		refiner = kernel;
+		pyramidWidth = pyramid;
+		fastReject = reject;
+
+		// the saddle detector orders corners by the image, findChessboardCorners() may
+		// return the same board rotated by 180 degrees, so compare in the closer order
+		if(found[0] && found[1])
+		{
+			double sum[2] = {0, 0}, maxd[2] = {0, 0};
+			for(int j = 0; j < board_n; j++)
 			{
-				cv::cvtColor(image, image, CV_RGB2GRAY);
+				for(int o = 0; o < 2; o++)
+				{
+					cv::Point2f d = corners[1][o ? board_n - 1 - j : j] - corners[0][j];
+					double distance = sqrt(d.x * d.x + d.y * d.y);
+					sum[o] += distance;
+					maxd[o] = max(maxd[o], distance);
+				}
 			}
-			cornerSubPix(image, corners,cv::Size(11, 11), cv::Size(-1, -1),
-					cv::TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 300, 0.01));
-			drawChessboardCorners(image, board_sz, corners, found);
-			imagePoints.push_back(corners);
-			objectPoints.push_back(boardModel);
+			int o = sum[1] < sum[0] ? 1 : 0;
+			sumDistance += sum[o];
+			maxDistance = max(maxDistance, maxd[o]);
+			nCompared++;
+		}
 
-			cout << "\033[0;32mCollected our \033[0m" << (int)imagePoints.size() 
-				<< "\033[0;32m of \033[0m" << n_boards
-				<< "\033[0;32m needed chessboard images \033[0m\n" << endl;
-			cv::imshow("Calibration", image);
-			
-			if(cv::waitKey(1000) == 27)
-				exit(0);
-		}
-		cv::destroyWindow("Calibration");
-
-		double err = cv::calibrateCamera(objectPoints, 
-			imagePoints, 
-			imageSize, 
-			cameraMatrix1, 
-			distCoeffs1,
-			cv::noArray(),
-			cv::noArray(),
-			cv::CALIB_FIX_PRINCIPAL_POINT
-			);
-		return 0;
-	}
-	
-	// calculate camera parameters with DCM
-	if(flag == FLAG_DOUBLE_CAMERAS)
-	{
-		cv::Mat image1, image2;
-		vector<vector<cv::Point2f> > imagePoints1;
-		vector<vector<cv::Point2f> > imagePoints2;
-		
-		for(int i = 0; i < n_boards; i++)
+		// both refining kernels start from the same corners found on the full image
+		vector<cv::Point2f> raw;
+		if(found[0] && cv::findChessboardCorners(image, board_sz, raw,
+					cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE))
 		{
-			image1 = cv::imread(directory + imageNames1[i], -1);
-			image2 = cv::imread(directory + imageNames2[i], -1);
-			vector<cv::Point2f> corners1, corners2;
-
-			bool found1 = cv::findChessboardCorners(image1, board_sz, corners1);
-			cout << "\n\033[0;32mfindChessboardCorners state (camera1): \033[0m" << found1;
-			bool found2 = cv::findChessboardCorners(image2, board_sz, corners2);
-			cout << "\n\033[0;32mfindChessboardCorners state (camera2): \033[0m" << found2 << endl;
+			vector<cv::Point2f> refined[2] = {raw, raw};
+			for(int setting = 0; setting < 2; setting++)
+			{
+				refiner = setting == 0 ? SUBPIX_OPENCV : SUBPIX_KERNEL;
+				int64 start = cv::getTickCount();
+				refineCorners(image, refined[setting]);
+				refineTimes[setting] += (cv::getTickCount() - start) / cv::getTickFrequency();
+			}
+			refiner = kernel;
 
-			if(image1.channels() != 1)
+			for(int j = 0; j < board_n; j++)
 			{
-				cv::cvtColor(image1, image1, CV_RGB2GRAY);
+				cv::Point2f d = refined[1][j] - refined[0][j];
+				double distance = sqrt(d.x * d.x + d.y * d.y);
+				sumRefineDistance += distance;
+				maxRefineDistance = max(maxRefineDistance, distance);
 			}
-			if(image2.channels() != 1)
+			nRefined++;
+
+			// corner 0 is displaced outward, away from its neighbours so the adaptive window
+			// stays, by growing fractions of a square, so its window leaves its patch on some
+			// of them while other corners are still active, and no other corner may change
+			cv::Point2f side = raw[1] - raw[0];
+			cv::Point2f outward = raw[0] * 2 - raw[1] - raw[board_w];
+			float spacing = sqrt(side.x * side.x + side.y * side.y);
+			float length = sqrt(outward.x * outward.x + outward.y * outward.y);
+			for(int step = 0; board_h > 1 && length > 0 && step < 7; step++)
 			{
-				cv::cvtColor(image2, image2, CV_RGB2GRAY);
+				vector<cv::Point2f> displaced = raw;
+				displaced[0] += outward * ((0.2f + 0.05f * step) * spacing / length);
+				refiner = SUBPIX_KERNEL;
+				refineCorners(image, displaced);
+				refiner = kernel;
+				for(int j = 1; j < board_n; j++)
+				{
+					cv::Point2f d = displaced[j] - refined[1][j];
+					maxIsolationDistance = max(maxIsolationDistance, (double)sqrt(d.x * d.x + d.y * d.y));
+				}
 			}
-			cornerSubPix(image1, corners1,cv::Size(11, 11), cv::Size(-1, -1),
-					cv::TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 300, 0.01));
-			cornerSubPix(image2, corners2,cv::Size(11, 11), cv::Size(-1, -1),
-					cv::TermCriteria(CV_TERMCRIT_ITER + CV_TERMCRIT_EPS, 300, 0.01));
-			drawChessboardCorners(image1, board_sz, corners1, found1);
-			drawChessboardCorners(image2, board_sz, corners2, found2);
-
-			imagePoints1.push_back(corners1);
-			imagePoints2.push_back(corners2);
-			objectPoints.push_back(boardModel);
+		}
+	}
 
-			cout << "\033[0;32mCollected our \033[0m" << (int)imagePoints1.size() 
-				<< "\033[0;32m of \033[0m" << n_boards
-				<< "\033[0;32m needed chessboard images \033[0m\n" << endl;
-			cv::imshow("Calibration (camera1)", image1);
-			cv::imshow("Calibration (camera2)", image2);
-			
-			if(cv::waitKey(1000) == 27)
-				exit(0);
-		}
-		cv::destroyAllWindows();
-
-		double err1 = cv::calibrateCamera(objectPoints, 
-			imagePoints1, 
-			imageSize, 
-			cameraMatrix1, 
-			distCoeffs1,
-			cv::noArray(),
-			cv::noArray(),
-			cv::CALIB_FIX_PRINCIPAL_POINT
-			);
-		double err2 = cv::calibrateCamera(objectPoints, 
-			imagePoints2, 
-			imageSize, 
-			cameraMatrix2, 
-			distCoeffs2,
-			cv::noArray(),
-			cv::noArray(),
-			cv::CALIB_FIX_PRINCIPAL_POINT
-			);
+	if(nImages == 0)
+	{
+		cerr << "\033[0;32mERROR: No image to benchmark in\033[0m " << directory << endl;
+		return;
+	}
+	cout << "\033[0;32mimages: \033[0m" << nImages;
+	cout << "\n\033[0;32mreference  latency: \033[0m" << times[0] * 1000 / nImages << " ms"
+		<< "\033[0;32m, found: \033[0m" << nFound[0];
+	cout << "\n\033[0;32mconfigured latency: \033[0m" << times[1] * 1000 / nImages << " ms"
+		<< "\033[0;32m, found: \033[0m" << nFound[1];
+	if(nCompared > 0)
+	{
+		cout << "\n\033[0;32mcorner distance to reference: mean \033[0m"
+			<< sumDistance / (nCompared * board_n) << " px"
+			<< "\033[0;32m, max \033[0m" << maxDistance << " px";
+	}
+	if(nRefined > 0)
+	{
+		cout << "\n\033[0;32mcornerSubPix   latency: \033[0m" << refineTimes[0] * 1000 / nRefined << " ms";
+		cout << "\n\033[0;32mSubPixRefiner latency: \033[0m" << refineTimes[1] * 1000 / nRefined << " ms"
+			<< "\033[0;32m, distance to cornerSubPix: mean \033[0m"
+			<< sumRefineDistance / (nRefined * board_n) << " px"
+			<< "\033[0;32m, max \033[0m" << maxRefineDistance << " px";
+		cout << "\n\033[0;32mSubPixRefiner change of other corners when one leaves its patch: \033[0m"
+			<< maxIsolationDistance << " px (0 expected)";
+	}
+	cout << endl;
+}
 
-		cv::Mat E;
-		double err_relative = cv::stereoCalibrate(objectPoints,
-			imagePoints1, imagePoints2,
-			cameraMatrix1, distCoeffs1,
-			cameraMatrix2, distCoeffs2,
-			imageSize, R, T, E, F, cv::CALIB_FIX_INTRINSIC,
-			cv::TermCriteria(CV_TERMCRIT_ITER+CV_TERMCRIT_EPS, 100, 1e-5));
+// compare BundleAdjuster with calibrateCamera() on corners of camera1 collected before,
+// e.g. by loadCorners(), printing latency of both and differences of their intrinsics,
+// then views picked by selectViews() against all views by benchmarkSelection() if nSelectedViews > 0
+void Calibrator::benchmarkSolver()
+{
+	cout << "\n\033[0;32m********** Benchmark Solver **********\033[0m\n";
+	if(getnFrames() < 3)
+	{
+		cerr << "\033[0;32mERROR: At least 3 frames are needed to benchmark solvers, there are \033[0m"
+			<< getnFrames() << endl;
+		return;
+	}
+
+	// setting 0 is calibrateCamera(), setting 1 is BundleAdjuster
+	cv::Mat M[2], D[2], S[2];
+	double rms[2], times[2];
+	for(int setting = 0; setting < 2; setting++)
+	{
+		int64 start = cv::getTickCount();
+		rms[setting] = calibrateOne(objectPoints, imagePoints1, imageSize, M[setting], D[setting], S[setting],
+				setting == 0 ? SOLVER_OPENCV : SOLVER_SPARSE, nThreads);
+		times[setting] = (cv::getTickCount() - start) / cv::getTickFrequency();
+	}
+	if(rms[0] < 0 || rms[1] < 0)
+	{
+		cerr << "\033[0;32mERROR: Fail to calibrate by \033[0m"
+			<< (rms[0] < 0 ? "calibrateCamera()" : "BundleAdjuster") << endl;
+		return;
+	}
 
-		double avgError = assessError(imagePoints1, imagePoints2);
-		return avgError;
+	double focalDifference = max(fabs(M[1].at<double>(0, 0) - M[0].at<double>(0, 0)),
+			fabs(M[1].at<double>(1, 1) - M[0].at<double>(1, 1)));
+	double distortionDifference = 0;
+	for(int k = 0; k < 5; k++)
+	{
+		distortionDifference = max(distortionDifference,
+				fabs(D[1].at<double>(k) - D[0].at<double>(k)));
 	}
+	cout << "\033[0;32mframes: \033[0m" << getnFrames();
+	cout << "\n\033[0;32mcalibrateCamera latency: \033[0m" << times[0] * 1000 << " ms"
+		<< "\033[0;32m, RMS: \033[0m" << rms[0] << " px";
+	cout << "\n\033[0;32mBundleAdjuster  latency: \033[0m" << times[1] * 1000 << " ms"
+		<< "\033[0;32m, RMS: \033[0m" << rms[1] << " px";
+	cout << "\n\033[0;32mlargest difference of focal lengths: \033[0m" << focalDifference << " px"
+		<< "\033[0;32m, of distortion coefficients: \033[0m" << distortionDifference;
+	cout << endl;
+
+	if(nSelectedViews > 0)
+		benchmarkSelection(nSelectedViews);
 }
 
 // print camera parameters after calibrating
@@ -412,6 +2173,49 @@ void Calibrator::printCameraParas()
 	fs.release();
 }
 
+// rescale calibrated parameters to images of targetSize, as if every image were resized,
+// so a camera is calibrated at its native resolution once and never resized per frame
+// intrinsics scale with pixel centers kept in place, x' + 0.5 = (x + 0.5) * s,
+// distortion coefficients, R and T don't change, and F follows both camera matrices
+// targetSize: image size parameters are wanted for
+// return the scale of pixel distances, sqrt(sx * sy), so errors measured at the calibrated
+// size, e.g. the average error of calibrate(), are converted to targetSize, 1 if nothing scales
+double Calibrator::scaleCameraParas(cv::Size targetSize)
+{
+	if(targetSize == imageSize || targetSize.width <= 0 || targetSize.height <= 0 ||
+			imageSize.width <= 0 || imageSize.height <= 0)
+		return 1;
+
+	double sx = (double)targetSize.width / imageSize.width;
+	double sy = (double)targetSize.height / imageSize.height;
+	cv::Mat S = cv::Mat::eye(3, 3, CV_64F);
+	S.at<double>(0, 0) = sx;
+	S.at<double>(0, 2) = 0.5 * sx - 0.5;
+	S.at<double>(1, 1) = sy;
+	S.at<double>(1, 2) = 0.5 * sy - 0.5;
+
+	if(!cameraMatrix1.empty())
+		cameraMatrix1 = S * cameraMatrix1;
+	if(flag == FLAG_DOUBLE_CAMERAS)
+	{
+		if(!cameraMatrix2.empty())
+			cameraMatrix2 = S * cameraMatrix2;
+		// x2' F' x1' = 0 with x' = S x gives F' = S^-T F S^-1
+		if(!F.empty())
+		{
+			cv::Mat Sinv = S.inv();
+			F = Sinv.t() * F * Sinv;
+			if(fabs(F.at<double>(2, 2)) > 1e-12)
+				F = F / F.at<double>(2, 2);
+		}
+	}
+
+	cout << "\n\033[0;32mScale camera parameters from \033[0m" << imageSize.width << "x" << imageSize.height
+		<< "\033[0;32m to \033[0m" << targetSize.width << "x" << targetSize.height << endl;
+	setImageSize(targetSize);
+	return sqrt(sx * sy);
+}
+
 // assess results after calibrating DCM, and it is contained in function calcCameraParas(),
 // so generally you don't use it alone.
 // src1: imagePoints1
@@ -431,7 +2235,8 @@ double Calibrator::assessError(vector<vector<cv::Point2f> > src1,
 	double avgError = 0;
 	vector<cv::Point3f> lines[2];
 
-	for(int i = 0; i < n_boards; i++)
+	int nViews = (int)src1.size();
+	for(int i = 0; i < nViews; i++)
 	{
 		vector<cv::Point2f>& pt0 = src1[i];
 		vector<cv::Point2f>& pt1 = src2[i];
@@ -449,7 +2254,8 @@ double Calibrator::assessError(vector<vector<cv::Point2f> > src1,
 			avgError += error;
 		}
 	}
-	avgError = avgError / (n_boards * board_n);
+	if(nViews > 0)
+		avgError = avgError / (nViews * board_n);
 
 	return avgError;
 }
@@ -537,11 +2343,31 @@ int Calibrator::getnBoards()
 	return n_boards;
 }
 
+int Calibrator::getFlag()
+{
+	return flag;
+}
+
+int Calibrator::getNumThreads()
+{
+	return nThreads;
+}
+
+int Calibrator::getDisplayMode()
+{
+	return displayMode;
+}
+
 cv::Size Calibrator::getImageSize()
 {
 	return imageSize;
 }
 
+cv::Size Calibrator::getBoardSize()
+{
+	return board_sz;
+}
+
 cv::Mat Calibrator::getCameraMatrix1()
 {
 	return cameraMatrix1;
@@ -583,6 +2409,124 @@ void Calibrator::setFilename(string filename)
 	this->filename = filename;
 }
 
+// imageSize: size of calibrated images, e.g. the native resolution of the camera
+void Calibrator::setImageSize(cv::Size imageSize)
+{
+	this->imageSize = imageSize;
+	imageWidth = imageSize.width;
+	imageHeight = imageSize.height;
+	coverage.reset(imageSize, board_sz);
+}
+
+// nThreads: number of threads detecting corners, 0 means using all cores
+void Calibrator::setNumThreads(int nThreads)
+{
+	this->nThreads = nThreads;
+}
+
+// displayMode: DISPLAY_NONE for headless machines, DISPLAY_PREVIEW or DISPLAY_STEP
+void Calibrator::setDisplayMode(int displayMode)
+{
+	this->displayMode = displayMode;
+}
+
+// window: half side length of the search window of cornerSubPix, 11 * 11 by default
+// criteria: termination criteria of cornerSubPix, 300 iterations or 0.01 by default
+void Calibrator::setSubPixParas(cv::Size window, cv::TermCriteria criteria)
+{
+	subPixWindow = window;
+	subPixCriteria = criteria;
+}
+
+// prefetchDepth: number of images read ahead of detecting, 0 means twice nThreads
+void Calibrator::setPrefetchDepth(int prefetchDepth)
+{
+	this->prefetchDepth = prefetchDepth;
+}
+
+// pyramidWidth: images wider than it are detected on a downscaled pyramid level first,
+//               then corners are refined on the full image, 0 means always full image
+void Calibrator::setPyramidWidth(int pyramidWidth)
+{
+	this->pyramidWidth = pyramidWidth;
+}
+
+// fastReject: whether frames without a chessboard are rejected by a cheap check
+//             before the full detection, false by default since the check may reject
+//             small or distant boards findChessboardCorners() would find
+void Calibrator::setFastReject(bool fastReject)
+{
+	this->fastReject = fastReject;
+}
+
+// refiner: SUBPIX_OPENCV refines corners by cornerSubPix(), SUBPIX_KERNEL by SubPixRefiner,
+//          which shrinks the window on small squares, SUBPIX_OPENCV by default
+void Calibrator::setRefiner(int refiner)
+{
+	this->refiner = refiner;
+}
+
+// solver: SOLVER_OPENCV solves intrinsics by calibrateCamera(), SOLVER_SPARSE by BundleAdjuster,
+// whose cost grows linearly with views, for calibrating hundreds of boards
+void Calibrator::setSolver(int solver)
+{
+	this->solver = solver;
+}
+
+// stereoMode: STEREO_SEQUENTIAL solves both cameras, then R and T by stereoCalibrate(),
+// STEREO_JOINT solves intrinsics of both cameras, R and T in one optimization started
+// from closed forms, intrinsics are refined by both cameras and no solve waits for another
+void Calibrator::setStereoMode(int stereoMode)
+{
+	this->stereoMode = stereoMode;
+}
+
+// nSelectedViews: calibrate() solves only this many collected views picked by selectViews(),
+// 0 solves all collected views
+void Calibrator::setViewSelection(int nSelectedViews)
+{
+	this->nSelectedViews = nSelectedViews;
+}
+
+// nFolds: calibrate() runs crossValidate() with this many folds after solving, 0 skips it
+void Calibrator::setCrossValidation(int nFolds)
+{
+	this->nFolds = nFolds;
+}
+
+// outlierSigma: calibrate() drops views whose RMS reprojection error exceeds the median by
+// this many robust standard deviations and solves the rest again, 0 keeps all views
+void Calibrator::setOutlierRejection(double outlierSigma)
+{
+	this->outlierSigma = outlierSigma;
+}
+
+// targets of isConverged(), largest standard deviations of converged intrinsics
+// focal: of fx and fy in pixels, 1 by default
+// principal: of cx and cy in pixels, 1 by default, it's fixed by calibrate() anyway
+// distortion: of k1, k2, p1, p2 and k3, 0.005 by default
+void Calibrator::setUncertaintyTargets(double focal, double principal, double distortion)
+{
+	focalTarget = focal;
+	principalTarget = principal;
+	distortionTarget = distortion;
+}
+
+// detector: DETECTOR_OPENCV finds corners by findChessboardCorners(), DETECTOR_SADDLE
+//           by SaddleDetector, which is faster on clean boards, DETECTOR_OPENCV by default
+void Calibrator::setDetector(int detector)
+{
+	this->detector = detector;
+}
+
+// useCornerCache: if it's true, calcCameraParas() caches corners in corners_cache.yml
+// of the image directory, and images detected before with the same parameters are
+// not detected again, so only calibration is repeated
+void Calibrator::setCornerCache(bool useCornerCache)
+{
+	this->useCornerCache = useCornerCache;
+}
+
 void Calibrator::setCameraMatrix1(cv::Mat M1)
 {
 	cameraMatrix1 = M1;
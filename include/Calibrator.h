@@ -2,12 +2,87 @@
 #define CALIBRATOR_H_
 
 #include <string>
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <opencv2/core/core.hpp>
 
+#include "Viewer.h"
+#include "ImageWriter.h"
+#include "BlockingQueue.h"
+#include "SaddleDetector.h"
+#include "SubPixRefiner.h"
+#include "CoverageMap.h"
+#include "BundleAdjuster.h"
+#include "ViewSelector.h"
+
 using namespace std;
 
 enum {FLAG_SINGLE_CAMERA = 0, FLAG_DOUBLE_CAMERAS = 1};
 
+// version of the binary file of saveCorners() and loadCorners()
+const int CORNER_FILE_VERSION = 1;
+
+// how detected chessboards are shown while calculating camera parameters
+// DISPLAY_NONE: headless, nothing is shown
+// DISPLAY_PREVIEW: every board is shown by a Viewer thread as soon as it's detected
+// DISPLAY_STEP: every board is shown for one second, ESC to quit, it detects boards serially
+enum {DISPLAY_NONE = 0, DISPLAY_PREVIEW = 1, DISPLAY_STEP = 2};
+
+// engine finding inner corners before subpixel refinement
+// DETECTOR_OPENCV: findChessboardCorners() of OpenCV
+// DETECTOR_SADDLE: SaddleDetector, which finds saddle points and grows a grid of them
+enum {DETECTOR_OPENCV = 0, DETECTOR_SADDLE = 1};
+
+// kernel refining inner corners to subpixel accuracy
+// SUBPIX_OPENCV: cornerSubPix() of OpenCV with subPixWindow
+// SUBPIX_KERNEL: SubPixRefiner, with a window no larger than subPixWindow fitting the squares
+enum {SUBPIX_OPENCV = 0, SUBPIX_KERNEL = 1};
+
+// solver of intrinsics and poses of calibrated views
+// SOLVER_OPENCV: calibrateCamera() of OpenCV, a dense Levenberg-Marquardt
+// SOLVER_SPARSE: BundleAdjuster, which eliminates poses by the Schur complement
+enum {SOLVER_OPENCV = 0, SOLVER_SPARSE = 1};
+
+// how a DCM is calibrated
+// STEREO_SEQUENTIAL: both cameras by the solver, then R and T by stereoCalibrate() with fixed intrinsics
+// STEREO_JOINT: intrinsics of both cameras, R and T together by BundleAdjuster::calibrateStereo()
+enum {STEREO_SEQUENTIAL = 0, STEREO_JOINT = 1};
+
+// result of detecting inner corners on one calibrated image,
+// pixels of the image are released as soon as it's detected
+struct BoardDetection
+{
+	bool found;                    // whether all inner corners are found
+	vector<cv::Point2f> corners;   // inner corners after subpixel refinement
+	BoardDetection() : found(false) {}
+};
+
+// an image read ahead by detectBoards(), waiting to be detected
+struct LoadedImage
+{
+	int task;                      // index of the image among all images to detect
+	string key;                    // key in cornerCache, empty if corners aren't cached
+	bool cached;                   // whether corners are taken from cornerCache
+	bool found;                    // whether all cached inner corners are found
+	vector<cv::Point2f> corners;   // cached inner corners
+	cv::Mat image;                 // decoded image, empty if it isn't needed
+	LoadedImage() : task(0), cached(false), found(false) {}
+};
+
+// reprojection errors of one view solved by calibrate(), kept for the error report
+struct ViewError
+{
+	int view;                      // index of the view among collected views, as saveCorners() stores them
+	int round;                     // rejection round dropping the view, 0 if it's kept
+	double rms1;                   // RMS error of one camera or camera1 of DCM, -1 if it isn't posed
+	double rms2;                   // RMS error of camera2 of DCM, -1 if it isn't posed
+	vector<float> errors1;         // error of every corner of one camera or camera1 of DCM
+	vector<float> errors2;         // error of every corner of camera2 of DCM
+	ViewError() : view(0), round(0), rms1(-1), rms2(-1) {}
+};
+
 class Calibrator
 {
 	private:
@@ -19,6 +94,29 @@ class Calibrator
 		int board_n;              // number of inner corners on your chessboard
 		float squareWidth;        // side length of a square on your chessboard
 		int flag;                 // symbol to calibrate one camera or double-camera module(DCM)
+		int nThreads;             // number of threads detecting corners, 0 means all cores
+		int displayMode;          // DISPLAY_NONE, DISPLAY_PREVIEW or DISPLAY_STEP
+		cv::Size subPixWindow;    // half side length of the search window of cornerSubPix
+		cv::TermCriteria subPixCriteria;  // termination criteria of cornerSubPix
+		bool useCornerCache;      // whether corners detected on saved images are cached
+		int prefetchDepth;        // number of images read ahead of detecting, 0 means twice nThreads
+		int pyramidWidth;         // wider images are detected on a pyramid level first, 0 disables
+		bool fastReject;          // whether frames without chessboard are rejected cheaply first
+		atomic<int> nRejected;    // frames rejected by the cheap check
+		int detector;             // DETECTOR_OPENCV or DETECTOR_SADDLE
+		SaddleDetector saddleDetector;  // finds corners when detector = DETECTOR_SADDLE
+		int refiner;              // SUBPIX_OPENCV or SUBPIX_KERNEL
+		SubPixRefiner subPixRefiner;    // refines corners when refiner = SUBPIX_KERNEL
+		int solver;               // SOLVER_OPENCV or SOLVER_SPARSE
+		int stereoMode;           // STEREO_SEQUENTIAL or STEREO_JOINT
+		int nSelectedViews;       // views picked by selectViews() to solve, 0 solves all
+		double outlierSigma;      // robust standard deviations above the median dropping a view, 0 keeps all
+		double rmsError1;         // RMS reprojection error of one camera or camera1 of DCM
+		double rmsError2;         // RMS reprojection error of camera2 of DCM
+		vector<ViewError> viewErrors;   // reprojection errors of every view of the last calibrate()
+		cv::Size errorImageSize;  // image size viewErrors are measured at
+		int nFolds;               // folds of crossValidate() run by calibrate(), 0 skips it
+		double heldOutError;      // held-out RMS error of the last crossValidate(), -1 if it isn't run
 		string filename;          // filename storing your results
 		string* imageNames;       // names of calibrated images with a single camera
 		string* imageNames1;      // names of calibrated images with camera1 of DCM
@@ -32,6 +130,53 @@ class Calibrator
 		cv::Mat R;                // rotation matrix from camera2 to camera1
 		cv::Mat T;                // transformation matrix from camera2 to camera1
 		cv::Mat F;                // fundermental matrix from camera2 to camera1
+		vector<vector<cv::Point3f> > objectPoints;  // board model of every collected frame
+		vector<vector<cv::Point2f> > imagePoints1;  // corners of one camera or camera1 of DCM
+		vector<vector<cv::Point2f> > imagePoints2;  // corners of camera2 of DCM
+		Viewer viewer;            // shows detected boards when displayMode = DISPLAY_PREVIEW
+		ImageWriter writer;       // writes images of saveImages() on its own thread
+		map<string, BoardDetection> cornerCache;  // detections keyed by image and detection hash
+		mutex cacheMutex;         // guards cornerCache and nCacheHits
+		int nCacheHits;           // images whose corners are found in cornerCache
+		CoverageMap coverage;     // coverage of collected corners, updated by getCoverage()
+		double focalTarget;       // largest standard deviation of focal lengths to converge, pixels
+		double principalTarget;   // largest standard deviation of the principal point to converge
+		double distortionTarget;  // largest standard deviation of distortion coefficients to converge
+		cv::Mat stdDevs1;         // standard deviations of fx, fy, cx, cy, k1, k2, p1, p2, k3 of camera1
+		cv::Mat stdDevs2;         // standard deviations of intrinsics of camera2 of DCM
+		int nEstimatedViews;      // views stdDevs1 and stdDevs2 are estimated from
+		int nRequestedViews;      // views of the running or the last estimate
+		bool estimating;          // whether uncertaintyWorker is estimating
+		mutex uncertaintyMutex;   // guards stdDevs1, stdDevs2, nEstimatedViews and estimating
+		thread uncertaintyWorker; // estimates uncertainty of collected views in background
+
+		bool quickCheckBoard(const cv::Mat& gray);
+		bool detectCorners(cv::Mat& image, vector<cv::Point2f>& corners);
+		void refineCorners(const cv::Mat& gray, vector<cv::Point2f>& corners);
+		void loadImage(string path, LoadedImage& loaded, bool withImage);
+		bool detectLoaded(LoadedImage& loaded, vector<cv::Point2f>& corners, cv::Mat* view);
+		bool detectImage(string path, vector<cv::Point2f>& corners, cv::Mat* view);
+		void detectBoards(string directory,
+				vector<BoardDetection>& detections1, vector<BoardDetection>& detections2);
+		void detectBoardsStepwise(string directory,
+				vector<BoardDetection>& detections1, vector<BoardDetection>& detections2);
+		void printRunSummary();
+		void solveCameras(const vector<vector<cv::Point3f> >& objects,
+				const vector<vector<cv::Point2f> >& points1, const vector<vector<cv::Point2f> >& points2,
+				bool useGuess);
+		void measureViewErrors(const vector<vector<cv::Point3f> >& objects,
+				const vector<vector<cv::Point2f> >& points1, const vector<vector<cv::Point2f> >& points2,
+				const vector<int>& views);
+		double crossValidate(const vector<vector<cv::Point3f> >& objects,
+				const vector<vector<cv::Point2f> >& points1, const vector<vector<cv::Point2f> >& points2,
+				int nFolds);
+		vector<int> findOutliers(const vector<int>& views, int nDroppable);
+		void printErrorReport();
+		void saveErrorReport();
+		bool meetsTargets(const cv::Mat& stdDevs);
+		string cornerCacheKey(const vector<uchar>& bytes);
+		void loadCornerCache(string cacheFile);
+		void saveCornerCache(string cacheFile);
 	
 	public:
 		Calibrator();
@@ -48,8 +193,29 @@ class Calibrator
 		void setImageNames();
 		void saveImages(int frameNumber, string directory,
 				cv::Mat frame1, cv::Mat frame2 = cv::Mat());
+		bool waitSavedImages();
 		vector<cv::Point3f> setBoardModel();
+		bool addFrame(cv::Mat frame1, cv::Mat frame2 = cv::Mat());
+		bool findBoard(cv::Mat frame, vector<cv::Point2f>& corners);
+		bool addCorners(const vector<cv::Point2f>& corners1,
+				const vector<cv::Point2f>& corners2 = vector<cv::Point2f>());
+		int getnFrames();
+		const CoverageMap& getCoverage();
+		void updateUncertainty();
+		void waitUncertainty();
+		bool isConverged();
+		void printUncertainty();
+		void clearFrames();
+		vector<int> selectViews(int nSelected);
 		double calcCameraParas(string directory = "");	
+		double calibrate();
+		double crossValidate(int nFolds);
+		double scaleCameraParas(cv::Size targetSize);
+		void benchmarkDetection(string directory);
+		void benchmarkSolver();
+		void benchmarkSelection(int nSelected);
+		bool saveCorners(string cornerFile);
+		bool loadCorners(string cornerFile);
 		void saveCameraParas(double avgError = 0);
 		void printCameraParas();
 		double assessError(vector<vector<cv::Point2f> > src1,
@@ -59,7 +225,11 @@ class Calibrator
 		// get elements' values of Calibrator
 		string getFilename();
 		int getnBoards();
+		int getFlag();
+		int getNumThreads();
+		int getDisplayMode();
         cv::Size getImageSize();
+		cv::Size getBoardSize();
 		cv::Mat getCameraMatrix1();
 		cv::Mat getDistCoeffs1();
 		cv::Mat getCameraMatrix2();
@@ -70,6 +240,22 @@ class Calibrator
 		
 		// set elements' values of Calibrator 
 		void setFilename(string filename);
+		void setImageSize(cv::Size imageSize);
+		void setNumThreads(int nThreads);
+		void setDisplayMode(int displayMode);
+		void setSubPixParas(cv::Size window, cv::TermCriteria criteria);
+		void setCornerCache(bool useCornerCache);
+		void setPrefetchDepth(int prefetchDepth);
+		void setPyramidWidth(int pyramidWidth);
+		void setFastReject(bool fastReject);
+		void setDetector(int detector);
+		void setRefiner(int refiner);
+		void setSolver(int solver);
+		void setStereoMode(int stereoMode);
+		void setViewSelection(int nSelectedViews);
+		void setOutlierRejection(double outlierSigma);
+		void setCrossValidation(int nFolds);
+		void setUncertaintyTargets(double focal, double principal, double distortion);
 		void setCameraMatrix1(cv::Mat M1);
 		void setDistCoeffs1(cv::Mat D1);
 		void setCameraMatrix2(cv::Mat M2);
@@ -0,0 +1,127 @@
+#include "CornerTracker.h"
+
+#include <cmath>
+#include <opencv2/video/tracking.hpp>
+
+static float length(cv::Point2f v)
+{
+	return sqrt(v.x * v.x + v.y * v.y);
+}
+
+// Constructors
+// board_sz: size of inner corners
+// winSize: search window of optical flow, it bounds the motion tracked on every level
+// maxLevel: highest pyramid level, motion up to winSize * 2^maxLevel / 2 pixels is tracked
+// maxError: maximum forward-backward error of a corner in pixels
+CornerTracker::CornerTracker(cv::Size board_sz, cv::Size winSize, int maxLevel, float maxError)
+{
+	this->board_sz = board_sz;
+	this->winSize = winSize;
+	this->maxLevel = maxLevel;
+	this->maxError = maxError;
+	tracking = false;
+	nTracked = 0;
+}
+
+// methods
+// start tracking from a full detection, or stop tracking if corners are empty
+// gray: 8-bit gray frame corners are detected on
+// corners: inner corners found by the full detection
+void CornerTracker::reset(const cv::Mat& gray, const vector<cv::Point2f>& corners)
+{
+	nTracked = 0;
+	tracking = !corners.empty();
+	prevCorners = corners;
+	prevPyramid.clear();
+	if(tracking)
+		cv::buildOpticalFlowPyramid(gray, prevPyramid, winSize, maxLevel);
+}
+
+// track corners of the last frame onto gray
+// the pyramid of gray is built once, and it's reused as the last frame of the next call
+// gray: 8-bit gray frame following the last one
+// corners: tracked inner corners, empty if tracking is lost
+// return false if it isn't tracking or tracking is lost, then a full detection is needed
+bool CornerTracker::track(const cv::Mat& gray, vector<cv::Point2f>& corners)
+{
+	corners.clear();
+	if(!tracking)
+		return false;
+
+	vector<cv::Mat> pyramid;
+	cv::buildOpticalFlowPyramid(gray, pyramid, winSize, maxLevel);
+
+	vector<cv::Point2f> forward, backward;
+	vector<uchar> statusForward, statusBackward;
+	vector<float> errors;
+	cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 20, 0.03);
+	cv::calcOpticalFlowPyrLK(prevPyramid, pyramid, prevCorners, forward,
+			statusForward, errors, winSize, maxLevel, criteria);
+	// tracking back from where corners are now tells a drifting corner
+	backward = prevCorners;
+	cv::calcOpticalFlowPyrLK(pyramid, prevPyramid, forward, backward,
+			statusBackward, errors, winSize, maxLevel, criteria, cv::OPTFLOW_USE_INITIAL_FLOW);
+
+	bool good = forward.size() == prevCorners.size();
+	for(size_t j = 0; j < forward.size() && good; j++)
+	{
+		good = statusForward[j] && statusBackward[j] &&
+			length(backward[j] - prevCorners[j]) <= maxError &&
+			forward[j].x >= 0 && forward[j].y >= 0 &&
+			forward[j].x < gray.cols && forward[j].y < gray.rows;
+	}
+	if(!good || !isRegular(forward))
+	{
+		tracking = false;
+		prevCorners.clear();
+		prevPyramid.clear();
+		return false;
+	}
+
+	prevPyramid.swap(pyramid);
+	prevCorners = forward;
+	corners = forward;
+	nTracked++;
+	return true;
+}
+
+// whether every corner is close to the middle of its two neighbours on a row or a column,
+// a corner sliding along an edge of a square breaks it long before its error shows
+bool CornerTracker::isRegular(const vector<cv::Point2f>& corners) const
+{
+	int W = board_sz.width, H = board_sz.height;
+	if((int)corners.size() != W * H)
+		return false;
+	for(int r = 0; r < H; r++)
+	{
+		for(int c = 0; c < W; c++)
+		{
+			const cv::Point2f& p = corners[r * W + c];
+			if(c > 0 && c < W - 1)
+			{
+				const cv::Point2f& left = corners[r * W + c - 1];
+				const cv::Point2f& right = corners[r * W + c + 1];
+				if(length(left + right - p * 2.f) > 0.15f * length(right - left))
+					return false;
+			}
+			if(r > 0 && r < H - 1)
+			{
+				const cv::Point2f& up = corners[(r - 1) * W + c];
+				const cv::Point2f& down = corners[(r + 1) * W + c];
+				if(length(up + down - p * 2.f) > 0.15f * length(down - up))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool CornerTracker::isTracking() const
+{
+	return tracking;
+}
+
+int CornerTracker::getnTracked() const
+{
+	return nTracked;
+}
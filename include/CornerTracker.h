@@ -0,0 +1,37 @@
+#ifndef CORNER_TRACKER_H_
+#define CORNER_TRACKER_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// CornerTracker follows the inner corners of a chessboard from frame to frame
+// with pyramidal Lucas-Kanade optical flow, so a live loop runs the full detection
+// only when tracking quality drops instead of on every frame.
+// A track is accepted if every corner is found forwards and backwards,
+// comes back to where it started, and the corners still form a regular grid.
+class CornerTracker
+{
+	private:
+		cv::Size board_sz;        // size of inner corners
+		cv::Size winSize;         // search window of optical flow on every pyramid level
+		int maxLevel;             // highest pyramid level of optical flow
+		float maxError;           // maximum forward-backward error of a corner in pixels
+		bool tracking;            // whether corners of the last frame are known
+		vector<cv::Mat> prevPyramid;     // pyramid of the last frame
+		vector<cv::Point2f> prevCorners; // corners on the last frame
+		int nTracked;             // frames tracked since the last detection
+
+		bool isRegular(const vector<cv::Point2f>& corners) const;
+
+	public:
+		CornerTracker(cv::Size board_sz, cv::Size winSize = cv::Size(21, 21),
+				int maxLevel = 3, float maxError = 1.f);
+		void reset(const cv::Mat& gray, const vector<cv::Point2f>& corners);
+		bool track(const cv::Mat& gray, vector<cv::Point2f>& corners);
+		bool isTracking() const;
+		int getnTracked() const;
+};
+
+#endif
@@ -0,0 +1,231 @@
+#include "CoverageMap.h"
+
+#include <cmath>
+#include <cstdio>
+#include <algorithm>
+#include <opencv2/imgproc/imgproc.hpp>
+
+// log ratio of opposite sides above which a board counts as tilted, about 10% longer
+static const double TILT_THRESHOLD = 0.1;
+
+static float length(cv::Point2f v)
+{
+	return sqrt(v.x * v.x + v.y * v.y);
+}
+
+// Constructors
+// gridCols, gridRows: cells of the occupancy grid over every image
+// targetCells: fraction of cells every camera needs to cover, 0.8 by default
+// targetPoseBins: tilt bins out of 9 views need to fill, 5 by default,
+//                 e.g. frontal and tilted towards each side
+CoverageMap::CoverageMap(int gridCols, int gridRows, double targetCells, int targetPoseBins)
+{
+	this->gridCols = gridCols;
+	this->gridRows = gridRows;
+	this->targetCells = targetCells;
+	this->targetPoseBins = targetPoseBins;
+	reset(cv::Size(), cv::Size());
+}
+
+// methods
+// forget every view, and take the size of images and boards of following views
+void CoverageMap::reset(cv::Size imageSize, cv::Size board_sz)
+{
+	this->imageSize = imageSize;
+	this->board_sz = board_sz;
+	cells.assign(2 * gridCols * gridRows, 0);
+	poseBins.assign(9, 0);
+	nCameras = 1;
+	nViews = 0;
+}
+
+// add corners of one view
+// corners1: inner corners of one camera or camera1 of DCM
+// corners2: inner corners of camera2 of DCM, default value is empty with one camera
+void CoverageMap::addView(const vector<cv::Point2f>& corners1,
+		const vector<cv::Point2f>& corners2)
+{
+	for(int camera = 0; camera < 2; camera++)
+	{
+		const vector<cv::Point2f>& corners = camera == 0 ? corners1 : corners2;
+		for(size_t j = 0; j < corners.size(); j++)
+		{
+			int cell = cellOf(corners[j]);
+			if(cell >= 0)
+				cells[camera * gridCols * gridRows + cell]++;
+		}
+	}
+	if(!corners2.empty())
+		nCameras = 2;
+	int bin = poseBinOf(poseOf(corners1));
+	if(bin >= 0)
+		poseBins[bin]++;
+	nViews++;
+}
+
+// number of cells corners of a view would cover for the first time, in all cameras
+int CoverageMap::countNewCells(const vector<cv::Point2f>& corners1,
+		const vector<cv::Point2f>& corners2) const
+{
+	vector<bool> reached(cells.size(), false);
+	int nNew = 0;
+	for(int camera = 0; camera < 2; camera++)
+	{
+		const vector<cv::Point2f>& corners = camera == 0 ? corners1 : corners2;
+		for(size_t j = 0; j < corners.size(); j++)
+		{
+			int cell = cellOf(corners[j]);
+			if(cell < 0)
+				continue;
+			cell += camera * gridCols * gridRows;
+			if(cells[cell] == 0 && !reached[cell])
+			{
+				reached[cell] = true;
+				nNew++;
+			}
+		}
+	}
+	return nNew;
+}
+
+// pose descriptor of a board from its outer corners, without intrinsics:
+// its center and size relative to the image, and its tilts as log ratios of opposite sides,
+// left over right and top over bottom, the last three are doubled to weigh more
+// corners: inner corners of the board, empty descriptor if they aren't complete
+vector<double> CoverageMap::poseOf(const vector<cv::Point2f>& corners) const
+{
+	vector<double> pose;
+	int W = board_sz.width, H = board_sz.height;
+	if((int)corners.size() != W * H || W < 2 || H < 2 || imageSize.area() <= 0)
+		return pose;
+
+	cv::Point2f quad[4] = {corners[0], corners[W - 1], corners[W * H - 1], corners[W * (H - 1)]};
+	cv::Point2f center = (quad[0] + quad[1] + quad[2] + quad[3]) * 0.25f;
+
+	// area of the quadrangle by the shoelace formula
+	double area = 0;
+	for(int k = 0; k < 4; k++)
+		area += quad[k].x * quad[(k + 1) % 4].y - quad[(k + 1) % 4].x * quad[k].y;
+	double scale = sqrt(fabs(area) / 2 / imageSize.area());
+
+	// sides are told apart by where they are, so the order of corners doesn't matter
+	// sides[0]: more vertical sides, sides[1]: more horizontal sides,
+	// each with its position across, x or y of its middle, and its length
+	vector<pair<double, double> > sides[2];
+	for(int k = 0; k < 4; k++)
+	{
+		cv::Point2f a = quad[k], b = quad[(k + 1) % 4];
+		bool vertical = fabs(b.x - a.x) < fabs(b.y - a.y);
+		double across = vertical ? 0.5 * (a.x + b.x) : 0.5 * (a.y + b.y);
+		sides[vertical ? 0 : 1].push_back(make_pair(across, (double)length(b - a)));
+	}
+	double tilts[2] = {0, 0};
+	for(int k = 0; k < 2; k++)
+	{
+		if(sides[k].size() != 2)
+			continue;
+		sort(sides[k].begin(), sides[k].end());
+		if(sides[k][0].second > 0 && sides[k][1].second > 0)
+			tilts[k] = log(sides[k][0].second / sides[k][1].second);
+	}
+
+	pose.push_back((double)center.x / imageSize.width);
+	pose.push_back((double)center.y / imageSize.height);
+	pose.push_back(2 * scale);
+	pose.push_back(2 * tilts[0]);
+	pose.push_back(2 * tilts[1]);
+	return pose;
+}
+
+// tilt bin of a pose from poseOf(), 3 * (top to bottom) + (left to right), -1 if it's empty
+int CoverageMap::poseBinOf(const vector<double>& pose) const
+{
+	if(pose.size() < 5)
+		return -1;
+	double tiltX = pose[3] / 2, tiltY = pose[4] / 2;
+	int binX = tiltX > TILT_THRESHOLD ? 0 : (tiltX < -TILT_THRESHOLD ? 2 : 1);
+	int binY = tiltY > TILT_THRESHOLD ? 0 : (tiltY < -TILT_THRESHOLD ? 2 : 1);
+	return binY * 3 + binX;
+}
+
+// fraction of cells holding any corner of camera, 0 for camera1 or 1 for camera2 of DCM
+double CoverageMap::getCellCoverage(int camera) const
+{
+	int nCells = gridCols * gridRows, nCovered = 0;
+	for(int cell = 0; cell < nCells; cell++)
+		nCovered += cells[camera * nCells + cell] > 0;
+	return (double)nCovered / nCells;
+}
+
+// number of tilt bins holding any view
+int CoverageMap::getnPoseBins() const
+{
+	return (int)(poseBins.size() - count(poseBins.begin(), poseBins.end(), 0));
+}
+
+int CoverageMap::getnViews() const
+{
+	return nViews;
+}
+
+// whether every camera covers targetCells of its cells, and views fill targetPoseBins bins
+bool CoverageMap::isComplete() const
+{
+	if(nViews == 0)
+		return false;
+	for(int camera = 0; camera < nCameras; camera++)
+	{
+		if(getCellCoverage(camera) < targetCells)
+			return false;
+	}
+	return getnPoseBins() >= targetPoseBins;
+}
+
+// overlay coverage of camera on view, a live frame of the same size as images
+// covered cells are tinted green and empty cells red, and a 3 x 3 map of tilt bins
+// at the top left corner tells which tilts are still missing
+void CoverageMap::draw(cv::Mat& view, int camera) const
+{
+	if(view.empty() || view.channels() != 3 || imageSize.area() <= 0)
+		return;
+
+	cv::Mat tinted = view.clone();
+	int nCells = gridCols * gridRows;
+	for(int row = 0; row < gridRows; row++)
+	{
+		for(int col = 0; col < gridCols; col++)
+		{
+			cv::Point from(col * view.cols / gridCols, row * view.rows / gridRows);
+			cv::Point to((col + 1) * view.cols / gridCols - 1, (row + 1) * view.rows / gridRows - 1);
+			bool covered = cells[camera * nCells + row * gridCols + col] > 0;
+			cv::rectangle(tinted, from, to,
+					covered ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255), cv::FILLED);
+		}
+	}
+	cv::addWeighted(tinted, 0.25, view, 0.75, 0, view);
+
+	const int binSide = 12;
+	for(int bin = 0; bin < 9; bin++)
+	{
+		cv::Point from(8 + (bin % 3) * binSide, 8 + (bin / 3) * binSide);
+		cv::Point to(from.x + binSide - 2, from.y + binSide - 2);
+		cv::rectangle(view, from, to,
+				poseBins[bin] > 0 ? cv::Scalar(0, 255, 0) : cv::Scalar(0, 0, 255), cv::FILLED);
+	}
+
+	char text[64];
+	snprintf(text, sizeof(text), "cells %d%%  tilts %d/9",
+			(int)(getCellCoverage(camera) * 100 + 0.5), getnPoseBins());
+	cv::putText(view, text, cv::Point(8 + 3 * binSide + 8, 8 + 2 * binSide),
+			cv::FONT_HERSHEY_SIMPLEX, 0.5, cv::Scalar(0, 255, 255), 1);
+}
+
+// index of the occupancy cell holding p, -1 if p is outside the image
+int CoverageMap::cellOf(cv::Point2f p) const
+{
+	if(p.x < 0 || p.y < 0 || p.x >= imageSize.width || p.y >= imageSize.height)
+		return -1;
+	int col = (int)(p.x * gridCols / imageSize.width);
+	int row = (int)(p.y * gridRows / imageSize.height);
+	return row * gridCols + col;
+}
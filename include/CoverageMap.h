@@ -0,0 +1,46 @@
+#ifndef COVERAGE_MAP_H_
+#define COVERAGE_MAP_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// CoverageMap counts where collected corners are on the image and how boards are posed.
+// Every camera has an occupancy grid of corners over its image, and all views share
+// a histogram of board tilts, 3 bins left to right times 3 bins top to bottom.
+// It's updated one view at a time, and it tells when coverage targets are met.
+class CoverageMap
+{
+	private:
+		int gridCols;             // columns of the occupancy grid
+		int gridRows;             // rows of the occupancy grid
+		double targetCells;       // fraction of covered cells wanted for every camera
+		int targetPoseBins;       // number of filled tilt bins wanted
+		cv::Size imageSize;       // size of images corners are on
+		cv::Size board_sz;        // size of inner corners
+		vector<int> cells;        // corners in every cell, camera c from c * gridCols * gridRows
+		vector<int> poseBins;     // views in every tilt bin
+		int nCameras;             // cameras seen in views, 1 or 2
+		int nViews;               // views added
+
+		int cellOf(cv::Point2f p) const;
+
+	public:
+		CoverageMap(int gridCols = 8, int gridRows = 6, double targetCells = 0.8,
+				int targetPoseBins = 5);
+		void reset(cv::Size imageSize, cv::Size board_sz);
+		void addView(const vector<cv::Point2f>& corners1,
+				const vector<cv::Point2f>& corners2 = vector<cv::Point2f>());
+		int countNewCells(const vector<cv::Point2f>& corners1,
+				const vector<cv::Point2f>& corners2 = vector<cv::Point2f>()) const;
+		vector<double> poseOf(const vector<cv::Point2f>& corners) const;
+		int poseBinOf(const vector<double>& pose) const;
+		double getCellCoverage(int camera) const;
+		int getnPoseBins() const;
+		int getnViews() const;
+		bool isComplete() const;
+		void draw(cv::Mat& view, int camera) const;
+};
+
+#endif
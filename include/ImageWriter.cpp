@@ -0,0 +1,86 @@
+#include "ImageWriter.h"
+
+#include <opencv2/highgui/highgui.hpp>
+
+// Constructors
+// capacity: maximum number of images waiting to be written
+ImageWriter::ImageWriter(int capacity) : tasks(capacity)
+{
+	nPending = 0;
+}
+
+// class destructor
+// images already queued are written before the writer thread ends
+ImageWriter::~ImageWriter()
+{
+	tasks.close();
+	if(worker.joinable())
+		worker.join();
+}
+
+// methods
+// queue image to be written into path
+// image is copied, so the caller may reuse its buffer at once
+void ImageWriter::write(string path, cv::Mat image)
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		if(!worker.joinable())
+			worker = thread(&ImageWriter::run, this);
+		nPending++;
+	}
+
+	WriteTask task;
+	task.path = path;
+	task.image = image.clone();
+	if(!tasks.push(task))
+	{
+		lock_guard<mutex> lock(mtx);
+		nPending--;
+		failures.push_back(path + ": writer is closed");
+		idle.notify_all();
+	}
+}
+
+// wait until all queued images are written
+void ImageWriter::wait()
+{
+	unique_lock<mutex> lock(mtx);
+	while(nPending > 0)
+		idle.wait(lock);
+}
+
+// take messages of failed writes since last call
+vector<string> ImageWriter::getFailures()
+{
+	lock_guard<mutex> lock(mtx);
+	vector<string> taken;
+	taken.swap(failures);
+	return taken;
+}
+
+// loop of the writer thread
+void ImageWriter::run()
+{
+	WriteTask task;
+	while(tasks.pop(task))
+	{
+		string error;
+		try
+		{
+			if(!cv::imwrite(task.path, task.image))
+				error = "cannot write the file";
+		}
+		catch(cv::Exception& e)
+		{
+			error = e.what();
+		}
+		task.image.release();
+
+		lock_guard<mutex> lock(mtx);
+		if(!error.empty())
+			failures.push_back(task.path + ": " + error);
+		if(--nPending == 0)
+			idle.notify_all();
+	}
+}
@@ -0,0 +1,45 @@
+#ifndef IMAGE_WRITER_H_
+#define IMAGE_WRITER_H_
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+#include "BlockingQueue.h"
+
+using namespace std;
+
+// an image waiting to be written by ImageWriter
+struct WriteTask
+{
+	string path;      // file the image is written into
+	cv::Mat image;    // image owned by the task
+};
+
+// ImageWriter encodes and writes images on its own thread.
+// At most capacity images wait in memory, write() blocks when they are full.
+// Failed writes are collected instead of being ignored.
+class ImageWriter
+{
+	private:
+		BlockingQueue<WriteTask> tasks;  // images waiting to be written
+		thread worker;                   // writer thread, started by the first write()
+		mutex mtx;                       // guards nPending and failures
+		condition_variable idle;         // signaled when nPending drops to 0
+		int nPending;                    // images written neither successfully nor not
+		vector<string> failures;         // messages of failed writes not taken yet
+
+		void run();
+
+	public:
+		ImageWriter(int capacity = 8);
+		~ImageWriter();
+		void write(string path, cv::Mat image);
+		void wait();
+		vector<string> getFailures();
+};
+
+#endif
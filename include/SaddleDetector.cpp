@@ -0,0 +1,459 @@
+#include "SaddleDetector.h"
+
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// saddle response dxy^2 - dxx*dyy of n pixels in a row, negative responses are clamped to 0
+static void saddleRow(const float* dxx, const float* dyy, const float* dxy, float* out, int n)
+{
+	int x = 0;
+#if defined(__AVX__)
+	__m256 zero8 = _mm256_setzero_ps();
+	for(; x + 8 <= n; x += 8)
+	{
+		__m256 a = _mm256_loadu_ps(dxx + x);
+		__m256 b = _mm256_loadu_ps(dyy + x);
+		__m256 c = _mm256_loadu_ps(dxy + x);
+		__m256 r = _mm256_sub_ps(_mm256_mul_ps(c, c), _mm256_mul_ps(a, b));
+		_mm256_storeu_ps(out + x, _mm256_max_ps(r, zero8));
+	}
+#endif
+#if defined(__SSE2__)
+	__m128 zero4 = _mm_setzero_ps();
+	for(; x + 4 <= n; x += 4)
+	{
+		__m128 a = _mm_loadu_ps(dxx + x);
+		__m128 b = _mm_loadu_ps(dyy + x);
+		__m128 c = _mm_loadu_ps(dxy + x);
+		__m128 r = _mm_sub_ps(_mm_mul_ps(c, c), _mm_mul_ps(a, b));
+		_mm_storeu_ps(out + x, _mm_max_ps(r, zero4));
+	}
+#endif
+	for(; x < n; x++)
+	{
+		float r = dxy[x] * dxy[x] - dxx[x] * dyy[x];
+		out[x] = r > 0 ? r : 0;
+	}
+}
+
+// maximum of n values in a row
+static float rowMax(const float* row, int n)
+{
+	float result = 0;
+	int x = 0;
+#if defined(__SSE2__)
+	__m128 m = _mm_setzero_ps();
+	for(; x + 4 <= n; x += 4)
+		m = _mm_max_ps(m, _mm_loadu_ps(row + x));
+	float lanes[4];
+	_mm_storeu_ps(lanes, m);
+	result = max(max(lanes[0], lanes[1]), max(lanes[2], lanes[3]));
+#endif
+	for(; x < n; x++)
+		result = max(result, row[x]);
+	return result;
+}
+
+// whether any of 4 values from row is greater than threshold
+static bool anyAbove(const float* row, float threshold)
+{
+#if defined(__SSE2__)
+	return _mm_movemask_ps(_mm_cmpgt_ps(_mm_loadu_ps(row), _mm_set1_ps(threshold))) != 0;
+#else
+	return row[0] > threshold || row[1] > threshold || row[2] > threshold || row[3] > threshold;
+#endif
+}
+
+// offset of the peak of a parabola through (-1, left), (0, center) and (1, right)
+static float peakOffset(float left, float center, float right)
+{
+	float curvature = left - 2 * center + right;
+	if(curvature >= 0)
+		return 0;
+	float offset = 0.5f * (left - right) / curvature;
+	return max(-0.5f, min(0.5f, offset));
+}
+
+// index of the unused point nearest to p within tolerance, -1 if there isn't any
+static int nearestPoint(const vector<cv::Point2f>& points, const vector<bool>& used,
+		cv::Point2f p, float tolerance)
+{
+	int nearest = -1;
+	float best = tolerance * tolerance;
+	for(size_t k = 0; k < points.size(); k++)
+	{
+		if(used[k])
+			continue;
+		cv::Point2f d = points[k] - p;
+		float d2 = d.x * d.x + d.y * d.y;
+		if(d2 < best)
+		{
+			best = d2;
+			nearest = (int)k;
+		}
+	}
+	return nearest;
+}
+
+static float length(cv::Point2f v)
+{
+	return sqrt(v.x * v.x + v.y * v.y);
+}
+
+// Constructors
+// sigma: sigma of Gaussian smoothing, about a tenth of the smallest square side in pixels
+// minResponse: minimum saddle response, 50 means a contrast of about 12 gray levels when sigma = 1.5
+// candidatesPerCorner: strongest candidates kept per inner corner, others are ignored
+// maxSeeds: strongest candidates tried as seeds before giving up
+SaddleDetector::SaddleDetector(double sigma, float minResponse,
+		int candidatesPerCorner, int maxSeeds)
+{
+	this->sigma = sigma;
+	this->minResponse = minResponse;
+	this->candidatesPerCorner = candidatesPerCorner;
+	this->maxSeeds = maxSeeds;
+}
+
+// methods
+// detect inner corners of a chessboard on a gray image
+// gray: 8-bit gray image
+// board_sz: size of inner corners
+// corners: inner corners, board_sz.width corners a row; rows point right in the image, or down
+//          if they are closer to vertical, and successive rows step clockwise of the row direction
+//          (down for rightward rows). This order is fixed by the image, not by the board, so it
+//          may be the reverse of findChessboardCorners() output for the same view
+// return true if all inner corners are found, corners are empty otherwise
+bool SaddleDetector::detect(const cv::Mat& gray, cv::Size board_sz,
+		vector<cv::Point2f>& corners) const
+{
+	corners.clear();
+	int board_n = board_sz.width * board_sz.height;
+	if(gray.empty() || gray.channels() != 1 || board_n <= 0)
+		return false;
+
+	cv::Mat response;
+	computeResponse(gray, response);
+
+	vector<cv::Point2f> points;
+	vector<float> strengths;
+	findCandidates(response, candidatesPerCorner * board_n, points, strengths);
+	if((int)points.size() < board_n)
+		return false;
+
+	// candidates are sorted by strength, and the strongest ones are most likely on the board
+	map<pair<int, int>, int> grid;
+	int nSeeds = min(maxSeeds, (int)points.size());
+	for(int seed = 0; seed < nSeeds; seed++)
+	{
+		if(growGrid(points, seed, grid) && (int)grid.size() >= board_n &&
+				extractBoard(points, strengths, grid, board_sz, corners))
+			return true;
+	}
+	corners.clear();
+	return false;
+}
+
+// saddle response of gray after Gaussian smoothing, it's 0 where it isn't a saddle
+void SaddleDetector::computeResponse(const cv::Mat& gray, cv::Mat& response) const
+{
+	cv::Mat smooth, dxx, dyy, dxy;
+	gray.convertTo(smooth, CV_32F);
+	cv::GaussianBlur(smooth, smooth, cv::Size(0, 0), sigma);
+	cv::Sobel(smooth, dxx, CV_32F, 2, 0, 3);
+	cv::Sobel(smooth, dyy, CV_32F, 0, 2, 3);
+	cv::Sobel(smooth, dxy, CV_32F, 1, 1, 3);
+
+	response.create(gray.size(), CV_32F);
+	for(int y = 0; y < gray.rows; y++)
+		saddleRow(dxx.ptr<float>(y), dyy.ptr<float>(y), dxy.ptr<float>(y),
+				response.ptr<float>(y), gray.cols);
+}
+
+// find local maxima of response as candidate corners with subpixel positions
+// response: saddle response from computeResponse()
+// maxCandidates: at most that many strongest candidates are kept
+// points: candidate corners, sorted from the strongest
+// strengths: saddle response of every candidate
+void SaddleDetector::findCandidates(const cv::Mat& response, int maxCandidates,
+		vector<cv::Point2f>& points, vector<float>& strengths) const
+{
+	points.clear();
+	strengths.clear();
+	int margin = (int)ceil(2 * sigma) + 2;
+	if(response.rows <= 2 * margin || response.cols <= 2 * margin)
+		return;
+
+	float maxValue = 0;
+	for(int y = margin; y < response.rows - margin; y++)
+		maxValue = max(maxValue, rowMax(response.ptr<float>(y), response.cols));
+	float threshold = max(minResponse, 0.05f * maxValue);
+
+	vector<pair<float, cv::Point2f> > peaks;
+	for(int y = margin; y < response.rows - margin; y++)
+	{
+		const float* r0 = response.ptr<float>(y - 1);
+		const float* r1 = response.ptr<float>(y);
+		const float* r2 = response.ptr<float>(y + 1);
+		for(int x = margin; x < response.cols - margin; x++)
+		{
+			// most pixels are below threshold, so they are skipped 4 by 4
+			if(x + 4 <= response.cols - margin && !anyAbove(r1 + x, threshold))
+			{
+				x += 3;
+				continue;
+			}
+
+			float v = r1[x];
+			if(v <= threshold)
+				continue;
+			// ties are broken by position, so a plateau gives only one peak
+			if(v <= r0[x - 1] || v <= r0[x] || v <= r0[x + 1] || v <= r1[x - 1] ||
+					v < r1[x + 1] || v < r2[x - 1] || v < r2[x] || v < r2[x + 1])
+				continue;
+
+			cv::Point2f p((float)x + peakOffset(r1[x - 1], v, r1[x + 1]),
+					(float)y + peakOffset(r0[x], v, r2[x]));
+			peaks.push_back(make_pair(v, p));
+		}
+	}
+
+	size_t n = min(peaks.size(), (size_t)max(maxCandidates, 0));
+	partial_sort(peaks.begin(), peaks.begin() + n, peaks.end(),
+			[](const pair<float, cv::Point2f>& a, const pair<float, cv::Point2f>& b)
+			{ return a.first > b.first; });
+	for(size_t k = 0; k < n; k++)
+	{
+		strengths.push_back(peaks[k].first);
+		points.push_back(peaks[k].second);
+	}
+}
+
+// grow a grid of candidates from points[seed]
+// two axes are taken from neighbours of the seed whose opposite points are candidates too,
+// then every grid node predicts its neighbours from known steps and takes the nearest candidate
+// points: candidate corners
+// seed: index of the seed in points, it's grid node (0, 0)
+// grid: maps grid node (i, j) to index of its candidate
+// return false if the seed has no two axes
+bool SaddleDetector::growGrid(const vector<cv::Point2f>& points, int seed,
+		map<pair<int, int>, int>& grid) const
+{
+	grid.clear();
+	const cv::Point2f s = points[seed];
+	vector<bool> used(points.size(), false);
+	used[seed] = true;
+
+	// 8 nearest neighbours hold both axes and diagonals of an X-junction
+	vector<pair<float, int> > neighbours;
+	for(size_t k = 0; k < points.size(); k++)
+	{
+		if((int)k == seed)
+			continue;
+		cv::Point2f d = points[k] - s;
+		neighbours.push_back(make_pair(d.x * d.x + d.y * d.y, (int)k));
+	}
+	size_t nNeighbours = min(neighbours.size(), (size_t)8);
+	partial_sort(neighbours.begin(), neighbours.begin() + nNeighbours, neighbours.end());
+
+	// axis a is valid if both s + u and s - u are candidates, shortest axes are taken
+	int axes[2][2] = {{-1, -1}, {-1, -1}};
+	cv::Point2f u[2];
+	int nAxes = 0;
+	for(size_t k = 0; k < nNeighbours && nAxes < 2; k++)
+	{
+		int forward = neighbours[k].second;
+		cv::Point2f step = points[forward] - s;
+		float stepLength = length(step);
+		if(stepLength < 2.f)
+			continue;
+		if(nAxes == 1)
+		{
+			float cross = fabs(u[0].x * step.y - u[0].y * step.x);
+			float ratio = stepLength / length(u[0]);
+			if(cross < 0.5f * stepLength * length(u[0]) || ratio < 0.5f || ratio > 2.f)
+				continue;
+		}
+		int backward = nearestPoint(points, used, s - step, 0.25f * stepLength);
+		if(backward < 0 || backward == forward)
+			continue;
+		axes[nAxes][0] = forward;
+		axes[nAxes][1] = backward;
+		u[nAxes] = step;
+		nAxes++;
+	}
+	if(nAxes < 2)
+		return false;
+
+	deque<pair<int, int> > open;
+	grid[make_pair(0, 0)] = seed;
+	open.push_back(make_pair(0, 0));
+	for(int a = 0; a < 2; a++)
+	{
+		pair<int, int> forward = a == 0 ? make_pair(1, 0) : make_pair(0, 1);
+		pair<int, int> backward = a == 0 ? make_pair(-1, 0) : make_pair(0, -1);
+		grid[forward] = axes[a][0];
+		grid[backward] = axes[a][1];
+		used[axes[a][0]] = used[axes[a][1]] = true;
+		open.push_back(forward);
+		open.push_back(backward);
+	}
+
+	const int directions[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+	while(!open.empty())
+	{
+		pair<int, int> node = open.front();
+		open.pop_front();
+		cv::Point2f p = points[grid[node]];
+
+		for(int d = 0; d < 4; d++)
+		{
+			int di = directions[d][0], dj = directions[d][1];
+			pair<int, int> target(node.first + di, node.second + dj);
+			if(grid.count(target))
+				continue;
+
+			// step from the node behind, from a parallel neighbouring line, or from the seed axes
+			cv::Point2f step = di != 0 ? u[0] * (float)di : u[1] * (float)dj;
+			map<pair<int, int>, int>::iterator behind =
+				grid.find(make_pair(node.first - di, node.second - dj));
+			if(behind != grid.end())
+				step = p - points[behind->second];
+			else
+			{
+				for(int side = -1; side <= 1; side += 2)
+				{
+					map<pair<int, int>, int>::iterator from =
+						grid.find(make_pair(node.first + side * dj, node.second + side * di));
+					map<pair<int, int>, int>::iterator to =
+						grid.find(make_pair(node.first + side * dj + di, node.second + side * di + dj));
+					if(from != grid.end() && to != grid.end())
+					{
+						step = points[to->second] - points[from->second];
+						break;
+					}
+				}
+			}
+
+			int k = nearestPoint(points, used, p + step, 0.3f * length(step));
+			if(k < 0)
+				continue;
+			grid[target] = k;
+			used[k] = true;
+			open.push_back(target);
+		}
+	}
+	return true;
+}
+
+// take the board_sz window of grid with the largest sum of strengths, and order its corners
+// the grid may be larger than the board, because outer corners of border squares are weak saddles
+// points, strengths: candidate corners and their saddle responses
+// grid: grid grown by growGrid()
+// board_sz: size of inner corners
+// corners: ordered inner corners
+// return true if a complete and regular window is found
+bool SaddleDetector::extractBoard(const vector<cv::Point2f>& points, const vector<float>& strengths,
+		const map<pair<int, int>, int>& grid, cv::Size board_sz,
+		vector<cv::Point2f>& corners) const
+{
+	int iMin = 0, iMax = 0, jMin = 0, jMax = 0;
+	for(map<pair<int, int>, int>::const_iterator it = grid.begin(); it != grid.end(); ++it)
+	{
+		iMin = min(iMin, it->first.first);
+		iMax = max(iMax, it->first.first);
+		jMin = min(jMin, it->first.second);
+		jMax = max(jMax, it->first.second);
+	}
+
+	// a window has board_sz.width nodes along i, or along j if it's transposed
+	int W = board_sz.width, H = board_sz.height;
+	bool found = false, bestTransposed = false;
+	int bestI = 0, bestJ = 0;
+	float bestScore = 0;
+	for(int transposed = 0; transposed < 2; transposed++)
+	{
+		int wi = transposed ? H : W;
+		int wj = transposed ? W : H;
+		for(int i0 = iMin; i0 + wi - 1 <= iMax; i0++)
+		{
+			for(int j0 = jMin; j0 + wj - 1 <= jMax; j0++)
+			{
+				float score = 0;
+				bool complete = true;
+				for(int di = 0; di < wi && complete; di++)
+				{
+					for(int dj = 0; dj < wj; dj++)
+					{
+						map<pair<int, int>, int>::const_iterator it =
+							grid.find(make_pair(i0 + di, j0 + dj));
+						if(it == grid.end())
+						{
+							complete = false;
+							break;
+						}
+						score += strengths[it->second];
+					}
+				}
+				if(complete && (!found || score > bestScore))
+				{
+					found = true;
+					bestScore = score;
+					bestI = i0;
+					bestJ = j0;
+					bestTransposed = transposed != 0;
+				}
+			}
+		}
+	}
+	if(!found)
+		return false;
+
+	// P[r][c]: corner on column c along the width and row r along the height of the board
+	vector<vector<cv::Point2f> > P(H, vector<cv::Point2f>(W));
+	for(int r = 0; r < H; r++)
+	{
+		for(int c = 0; c < W; c++)
+		{
+			pair<int, int> node = bestTransposed ? make_pair(bestI + r, bestJ + c)
+				: make_pair(bestI + c, bestJ + r);
+			P[r][c] = points[grid.find(node)->second];
+		}
+	}
+
+	// every corner is close to the middle of its two neighbours on a row or a column
+	for(int r = 0; r < H; r++)
+	{
+		for(int c = 0; c < W; c++)
+		{
+			if(c > 0 && c < W - 1 && length(P[r][c - 1] + P[r][c + 1] - P[r][c] * 2.f) >
+					0.15f * length(P[r][c + 1] - P[r][c - 1]))
+				return false;
+			if(r > 0 && r < H - 1 && length(P[r - 1][c] + P[r + 1][c] - P[r][c] * 2.f) >
+					0.15f * length(P[r + 1][c] - P[r - 1][c]))
+				return false;
+		}
+	}
+
+	// rows point right, or down if they are closer to vertical,
+	// and columns point to the right hand of rows, so orders of similar views agree
+	cv::Point2f rowDir = P[0][W - 1] - P[0][0] + P[H - 1][W - 1] - P[H - 1][0];
+	bool flipRows = fabs(rowDir.x) >= fabs(rowDir.y) ? rowDir.x < 0 : rowDir.y < 0;
+	if(flipRows)
+		rowDir = -rowDir;
+	cv::Point2f colDir = P[H - 1][0] - P[0][0] + P[H - 1][W - 1] - P[0][W - 1];
+	bool flipCols = colDir.x * -rowDir.y + colDir.y * rowDir.x < 0;
+
+	corners.resize(W * H);
+	for(int r = 0; r < H; r++)
+		for(int c = 0; c < W; c++)
+			corners[r * W + c] = P[flipCols ? H - 1 - r : r][flipRows ? W - 1 - c : c];
+	return true;
+}
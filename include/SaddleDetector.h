@@ -0,0 +1,39 @@
+#ifndef SADDLE_DETECTOR_H_
+#define SADDLE_DETECTOR_H_
+
+#include <vector>
+#include <map>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// SaddleDetector finds inner corners of a chessboard as saddle points of the image.
+// The saddle response dxy^2 - dxx*dyy of the smoothed image peaks at X-junctions
+// between squares, and a grid of peaks is grown from a seed peak and its neighbours.
+// Its runtime hardly depends on clutter, which makes it suitable for live frames.
+// detect() is const, so one SaddleDetector may be shared by detecting threads.
+class SaddleDetector
+{
+	private:
+		double sigma;          // sigma of Gaussian smoothing before derivatives
+		float minResponse;     // minimum saddle response of a candidate corner
+		int candidatesPerCorner;  // strongest candidates kept per inner corner of the board
+		int maxSeeds;          // strongest candidates tried as seeds of grid growing
+
+		void computeResponse(const cv::Mat& gray, cv::Mat& response) const;
+		void findCandidates(const cv::Mat& response, int maxCandidates,
+				vector<cv::Point2f>& points, vector<float>& strengths) const;
+		bool growGrid(const vector<cv::Point2f>& points, int seed,
+				map<pair<int, int>, int>& grid) const;
+		bool extractBoard(const vector<cv::Point2f>& points, const vector<float>& strengths,
+				const map<pair<int, int>, int>& grid, cv::Size board_sz,
+				vector<cv::Point2f>& corners) const;
+
+	public:
+		SaddleDetector(double sigma = 1.5, float minResponse = 50.f,
+				int candidatesPerCorner = 8, int maxSeeds = 10);
+		bool detect(const cv::Mat& gray, cv::Size board_sz,
+				vector<cv::Point2f>& corners) const;
+};
+
+#endif
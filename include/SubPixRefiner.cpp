@@ -0,0 +1,285 @@
+#include "SubPixRefiner.h"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// sums of a window row of one corner, namely sum of w*gx*gx, w*gx*gy, w*gy*gy,
+// and of the right side w*(gx*gx*dx + gx*gy*dy), w*(gx*gy*dx + gy*gy*dy)
+// gx, gy: gradients of the row
+// dx: horizontal offsets of the row pixels from the corner
+// wx: horizontal weights, weight of a pixel is wx * wy
+// wy, dy: vertical weight and offset of the row
+// sums: 5 sums the row is added to
+static void accumulateRow(const float* gx, const float* gy, const float* dx, const float* wx,
+		float wy, float dy, int n, float* sums)
+{
+	int x = 0;
+	float s[5] = {0, 0, 0, 0, 0};
+#if defined(__AVX__)
+	__m256 wy8 = _mm256_set1_ps(wy), dy8 = _mm256_set1_ps(dy);
+	__m256 sxx8 = _mm256_setzero_ps(), sxy8 = _mm256_setzero_ps(), syy8 = _mm256_setzero_ps();
+	__m256 bx8 = _mm256_setzero_ps(), by8 = _mm256_setzero_ps();
+	for(; x + 8 <= n; x += 8)
+	{
+		__m256 w = _mm256_mul_ps(_mm256_loadu_ps(wx + x), wy8);
+		__m256 a = _mm256_loadu_ps(gx + x);
+		__m256 b = _mm256_loadu_ps(gy + x);
+		__m256 d = _mm256_loadu_ps(dx + x);
+		__m256 wa = _mm256_mul_ps(w, a);
+		__m256 gxx = _mm256_mul_ps(wa, a);
+		__m256 gxy = _mm256_mul_ps(wa, b);
+		__m256 gyy = _mm256_mul_ps(_mm256_mul_ps(w, b), b);
+		sxx8 = _mm256_add_ps(sxx8, gxx);
+		sxy8 = _mm256_add_ps(sxy8, gxy);
+		syy8 = _mm256_add_ps(syy8, gyy);
+		bx8 = _mm256_add_ps(bx8, _mm256_add_ps(_mm256_mul_ps(gxx, d), _mm256_mul_ps(gxy, dy8)));
+		by8 = _mm256_add_ps(by8, _mm256_add_ps(_mm256_mul_ps(gxy, d), _mm256_mul_ps(gyy, dy8)));
+	}
+	__m256 sums8[5] = {sxx8, sxy8, syy8, bx8, by8};
+	for(int k = 0; k < 5; k++)
+	{
+		float lanes[8];
+		_mm256_storeu_ps(lanes, sums8[k]);
+		for(int l = 0; l < 8; l++)
+			s[k] += lanes[l];
+	}
+#endif
+#if defined(__SSE2__)
+	__m128 wy4 = _mm_set1_ps(wy), dy4 = _mm_set1_ps(dy);
+	__m128 sxx4 = _mm_setzero_ps(), sxy4 = _mm_setzero_ps(), syy4 = _mm_setzero_ps();
+	__m128 bx4 = _mm_setzero_ps(), by4 = _mm_setzero_ps();
+	for(; x + 4 <= n; x += 4)
+	{
+		__m128 w = _mm_mul_ps(_mm_loadu_ps(wx + x), wy4);
+		__m128 a = _mm_loadu_ps(gx + x);
+		__m128 b = _mm_loadu_ps(gy + x);
+		__m128 d = _mm_loadu_ps(dx + x);
+		__m128 wa = _mm_mul_ps(w, a);
+		__m128 gxx = _mm_mul_ps(wa, a);
+		__m128 gxy = _mm_mul_ps(wa, b);
+		__m128 gyy = _mm_mul_ps(_mm_mul_ps(w, b), b);
+		sxx4 = _mm_add_ps(sxx4, gxx);
+		sxy4 = _mm_add_ps(sxy4, gxy);
+		syy4 = _mm_add_ps(syy4, gyy);
+		bx4 = _mm_add_ps(bx4, _mm_add_ps(_mm_mul_ps(gxx, d), _mm_mul_ps(gxy, dy4)));
+		by4 = _mm_add_ps(by4, _mm_add_ps(_mm_mul_ps(gxy, d), _mm_mul_ps(gyy, dy4)));
+	}
+	__m128 sums4[5] = {sxx4, sxy4, syy4, bx4, by4};
+	for(int k = 0; k < 5; k++)
+	{
+		float lanes[4];
+		_mm_storeu_ps(lanes, sums4[k]);
+		s[k] += lanes[0] + lanes[1] + lanes[2] + lanes[3];
+	}
+#endif
+	for(; x < n; x++)
+	{
+		float w = wx[x] * wy;
+		float gxx = w * gx[x] * gx[x];
+		float gxy = w * gx[x] * gy[x];
+		float gyy = w * gy[x] * gy[x];
+		s[0] += gxx;
+		s[1] += gxy;
+		s[2] += gyy;
+		s[3] += gxx * dx[x] + gxy * dy;
+		s[4] += gxy * dx[x] + gyy * dy;
+	}
+	for(int k = 0; k < 5; k++)
+		sums[k] += s[k];
+}
+
+// Constructors
+// windowRatio: half side of the window to the side of the smallest square of the board
+// minWindow: smallest half side of the window in pixels
+SubPixRefiner::SubPixRefiner(float windowRatio, int minWindow)
+{
+	this->windowRatio = windowRatio;
+	this->minWindow = minWindow;
+}
+
+// methods
+// half side of the window for a board, it's windowRatio of the smallest distance between
+// neighbouring corners, so the window holds one corner only, but no more than maxWindow
+int SubPixRefiner::windowSize(const vector<cv::Point2f>& corners, cv::Size board_sz,
+		int maxWindow) const
+{
+	int W = board_sz.width, H = board_sz.height;
+	if((int)corners.size() != W * H || W * H < 2)
+		return maxWindow;
+
+	float minDistance2 = -1;
+	for(int r = 0; r < H; r++)
+	{
+		for(int c = 0; c < W; c++)
+		{
+			const cv::Point2f& p = corners[r * W + c];
+			for(int k = 0; k < 2; k++)
+			{
+				if((k == 0 && c + 1 >= W) || (k == 1 && r + 1 >= H))
+					continue;
+				cv::Point2f d = corners[k == 0 ? r * W + c + 1 : (r + 1) * W + c] - p;
+				float distance2 = d.x * d.x + d.y * d.y;
+				if(minDistance2 < 0 || distance2 < minDistance2)
+					minDistance2 = distance2;
+			}
+		}
+	}
+	int half = (int)(windowRatio * sqrt(max(minDistance2, 0.f)));
+	return max(min(half, maxWindow), min(minWindow, maxWindow));
+}
+
+// refine corners of one board to subpixel accuracy
+// gray: 8-bit gray image corners are found on
+// board_sz: size of inner corners, it tells neighbouring corners for the adaptive window
+// corners: corners to refine in place, a corner moving out of its window is kept unrefined
+// window: largest half side of the search window, like winSize of cornerSubPix()
+// criteria: maximum iterations and the shift below which a corner has converged
+// return the number of iterations the slowest corner took
+int SubPixRefiner::refine(const cv::Mat& gray, cv::Size board_sz, vector<cv::Point2f>& corners,
+		cv::Size window, cv::TermCriteria criteria) const
+{
+	int n = (int)corners.size();
+	if(n == 0 || gray.empty() || gray.channels() != 1)
+		return 0;
+
+	int maxCount = criteria.type & cv::TermCriteria::COUNT ? max(criteria.maxCount, 1) : 100;
+	float epsilon = criteria.type & cv::TermCriteria::EPS ? (float)criteria.epsilon : 0.f;
+	int half = windowSize(corners, board_sz, max(min(window.width, window.height), 1));
+	int L = 2 * half + 1;
+
+	// a patch of side S around the first position of every corner, so its window
+	// may move half pixels before it leaves the patch
+	int S = 4 * half + 1;
+	vector<float> gradX((size_t)n * S * S), gradY((size_t)n * S * S);
+	vector<int> originX(n), originY(n);
+	vector<float> row(S + 2);
+	for(int i = 0; i < n; i++)
+	{
+		originX[i] = cvRound(corners[i].x) - 2 * half;
+		originY[i] = cvRound(corners[i].y) - 2 * half;
+		float* gx = &gradX[(size_t)i * S * S];
+		float* gy = &gradY[(size_t)i * S * S];
+		bool inside = originX[i] >= 1 && originY[i] >= 1 &&
+			originX[i] + S < gray.cols && originY[i] + S < gray.rows;
+		for(int y = 0; y < S; y++)
+		{
+			int y0 = min(max(originY[i] + y - 1, 0), gray.rows - 1);
+			int y1 = min(max(originY[i] + y, 0), gray.rows - 1);
+			int y2 = min(max(originY[i] + y + 1, 0), gray.rows - 1);
+			const uchar* up = gray.ptr<uchar>(y0);
+			const uchar* center = gray.ptr<uchar>(y1);
+			const uchar* down = gray.ptr<uchar>(y2);
+			if(inside)
+			{
+				// most patches are inside the image, so their rows are read without clamping
+				up += originX[i];
+				center += originX[i];
+				down += originX[i];
+				for(int x = 0; x < S; x++)
+				{
+					gx[y * S + x] = 0.5f * ((float)center[x + 1] - (float)center[x - 1]);
+					gy[y * S + x] = 0.5f * ((float)down[x] - (float)up[x]);
+				}
+				continue;
+			}
+			for(int x = 0; x < S + 2; x++)
+				row[x] = center[min(max(originX[i] + x - 1, 0), gray.cols - 1)];
+			for(int x = 0; x < S; x++)
+			{
+				int xx = min(max(originX[i] + x, 0), gray.cols - 1);
+				gx[y * S + x] = 0.5f * (row[x + 2] - row[x]);
+				gy[y * S + x] = 0.5f * ((float)down[xx] - (float)up[xx]);
+			}
+		}
+	}
+
+	// positions and sums of every corner side by side, so 2x2 systems are solved in one loop
+	vector<float> qx(n), qy(n);
+	vector<float> sxx(n), sxy(n), syy(n), bx(n), by(n);
+	vector<int> active;
+	for(int i = 0; i < n; i++)
+	{
+		qx[i] = corners[i].x - originX[i];
+		qy[i] = corners[i].y - originY[i];
+		active.push_back(i);
+	}
+
+	vector<float> wx(L), wy(L), dx(L);
+	float coeff = 1.f / (half * half);
+	int iteration = 0;
+	while(!active.empty() && iteration < maxCount)
+	{
+		iteration++;
+		size_t nKept = 0;
+		for(size_t k = 0; k < active.size(); k++)
+		{
+			int i = active[k];
+			int cx = cvRound(qx[i]), cy = cvRound(qy[i]);
+			if(cx - half < 0 || cy - half < 0 || cx + half >= S || cy + half >= S)
+			{
+				// it moved away from where it was detected, so it's kept unrefined
+				qx[i] = corners[i].x - originX[i];
+				qy[i] = corners[i].y - originY[i];
+				continue;
+			}
+			for(int t = 0; t < L; t++)
+			{
+				dx[t] = cx - half + t - qx[i];
+				wx[t] = exp(-dx[t] * dx[t] * coeff);
+				float dy = cy - half + t - qy[i];
+				wy[t] = exp(-dy * dy * coeff);
+			}
+
+			float sums[5] = {0, 0, 0, 0, 0};
+			const float* gx = &gradX[(size_t)i * S * S];
+			const float* gy = &gradY[(size_t)i * S * S];
+			for(int t = 0; t < L; t++)
+			{
+				int y = cy - half + t;
+				accumulateRow(gx + y * S + cx - half, gy + y * S + cx - half, &dx[0], &wx[0],
+						wy[t], y - qy[i], L, sums);
+			}
+			// sums go to the position the corner takes in compacted active, where the
+			// second pass reads them
+			sxx[nKept] = sums[0];
+			sxy[nKept] = sums[1];
+			syy[nKept] = sums[2];
+			bx[nKept] = sums[3];
+			by[nKept] = sums[4];
+			active[nKept++] = i;
+		}
+		active.resize(nKept);
+
+		// shift of every active corner from its 2x2 system
+		nKept = 0;
+		for(size_t k = 0; k < active.size(); k++)
+		{
+			int i = active[k];
+			float det = sxx[k] * syy[k] - sxy[k] * sxy[k];
+			if(fabs(det) <= 1e-6f * (sxx[k] + syy[k]) * (sxx[k] + syy[k]))
+				continue;
+			float shiftX = (syy[k] * bx[k] - sxy[k] * by[k]) / det;
+			float shiftY = (sxx[k] * by[k] - sxy[k] * bx[k]) / det;
+			qx[i] += shiftX;
+			qy[i] += shiftY;
+			if(shiftX * shiftX + shiftY * shiftY > epsilon * epsilon)
+				active[nKept++] = i;
+		}
+		active.resize(nKept);
+	}
+
+	for(int i = 0; i < n; i++)
+	{
+		cv::Point2f refined(qx[i] + originX[i], qy[i] + originY[i]);
+		// like cornerSubPix(), a corner moving farther than its window is kept unrefined
+		if(fabs(refined.x - corners[i].x) <= half && fabs(refined.y - corners[i].y) <= half)
+			corners[i] = refined;
+	}
+	return iteration;
+}
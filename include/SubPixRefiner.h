@@ -0,0 +1,33 @@
+#ifndef SUBPIX_REFINER_H_
+#define SUBPIX_REFINER_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// SubPixRefiner refines inner corners of a chessboard to subpixel accuracy,
+// solving the same least squares problem as cornerSubPix(): the corner is where
+// gradients in its window are orthogonal to the vectors from the corner.
+// It differs from cornerSubPix() in how the work is organized:
+// - gradients of a patch around every corner are computed once, not per iteration
+// - sums of a window row are accumulated with SSE/AVX
+// - 2x2 systems of all corners of a board are solved together per iteration,
+//   and a corner leaves the iterations as soon as it converges
+// - the window shrinks on small squares, so it never covers neighbouring corners
+// refine() is const, so one SubPixRefiner may be shared by detecting threads.
+class SubPixRefiner
+{
+	private:
+		float windowRatio;        // half side of the window to the side of the smallest square
+		int minWindow;            // smallest half side of the window in pixels
+
+		int windowSize(const vector<cv::Point2f>& corners, cv::Size board_sz, int maxWindow) const;
+
+	public:
+		SubPixRefiner(float windowRatio = 0.4f, int minWindow = 3);
+		int refine(const cv::Mat& gray, cv::Size board_sz, vector<cv::Point2f>& corners,
+				cv::Size window, cv::TermCriteria criteria) const;
+};
+
+#endif
@@ -0,0 +1,198 @@
+#include "ViewSelector.h"
+#include "BundleAdjuster.h"
+
+#include <cmath>
+#include <queue>
+#include <iostream>
+#include <algorithm>
+
+// number of intrinsics of one camera, fx, fy, k1, k2, p1, p2, k3
+static const int N_INTRINSICS = 7;
+
+// log det of A + B, both symmetric N_INTRINSICS x N_INTRINSICS matrices, B may be NULL
+// return -infinity if A + B isn't positive definite
+static double logDet(const double* A, const double* B)
+{
+	const int n = N_INTRINSICS;
+	double L[n * n];
+	double result = 0;
+	for(int i = 0; i < n; i++)
+	{
+		for(int j = 0; j <= i; j++)
+		{
+			double s = A[i * n + j] + (B ? B[i * n + j] : 0);
+			for(int k = 0; k < j; k++)
+				s -= L[i * n + k] * L[j * n + k];
+			if(i == j)
+			{
+				if(!(s > 0))
+					return -HUGE_VAL;
+				L[i * n + i] = sqrt(s);
+				result += log(s);
+			}
+			else
+				L[i * n + j] = s / L[j * n + j];
+		}
+	}
+	return result;
+}
+
+// Constructor
+// pilotViews: views of the pilot calibration, evenly spaced among all views
+// prior: weight of the identity added to information normalized by its mean diagonal,
+//        it keeps log det finite before the first views determine all intrinsics
+// nThreads: threads of BundleAdjuster, 0 means all cores
+ViewSelector::ViewSelector(int pilotViews, double prior, int nThreads)
+{
+	this->pilotViews = pilotViews;
+	this->prior = prior;
+	this->nThreads = nThreads;
+	efficiency = 0;
+}
+
+// pick nSelected views with most information about intrinsics of one camera or both
+// objectPoints: board model of every view
+// imagePoints1: corners of every view in one camera or camera1 of DCM
+// imagePoints2: corners of every view in camera2 of DCM, empty with one camera
+// imageSize: image size of the cameras
+// return indices of picked views in ascending order, empty if the pilot calibration fails
+vector<int> ViewSelector::select(const vector<vector<cv::Point3f> >& objectPoints,
+		const vector<vector<cv::Point2f> >& imagePoints1,
+		const vector<vector<cv::Point2f> >& imagePoints2,
+		cv::Size imageSize, int nSelected)
+{
+	const int n = N_INTRINSICS;
+	int nViews = (int)objectPoints.size();
+	int nCameras = imagePoints2.empty() ? 1 : 2;
+	efficiency = 0;
+
+	// normalized information of every view in every camera, empty for views without pose
+	vector<vector<double> > information[2];
+	for(int camera = 0; camera < nCameras; camera++)
+	{
+		const vector<vector<cv::Point2f> >& imagePoints = camera == 0 ? imagePoints1 : imagePoints2;
+		int nPilot = min(pilotViews, nViews);
+		vector<vector<cv::Point3f> > pilotObjects;
+		vector<vector<cv::Point2f> > pilotPoints;
+		for(int k = 0; k < nPilot; k++)
+		{
+			int v = (int)((long long)k * nViews / nPilot);
+			pilotObjects.push_back(objectPoints[v]);
+			pilotPoints.push_back(imagePoints[v]);
+		}
+
+		BundleAdjuster adjuster(nThreads);
+		cv::Mat cameraMatrix, distCoeffs, stdDevs;
+		if(adjuster.calibrate(pilotObjects, pilotPoints, imageSize, cameraMatrix, distCoeffs, stdDevs) < 0)
+		{
+			cerr << "\033[0;32mERROR: Fail to calibrate pilot views to select views.\033[0m" << endl;
+			return vector<int>();
+		}
+		vector<cv::Mat> views;
+		adjuster.viewInformation(objectPoints, imagePoints, cameraMatrix, distCoeffs, views);
+
+		// log det is invariant to scaling parameters, so information is scaled by its mean
+		// diagonal, which keeps fx and k3 on the same footing for the prior and Cholesky
+		double diagonal[n] = {0};
+		int nPosed = 0;
+		for(int v = 0; v < nViews; v++)
+		{
+			if(views[v].empty())
+				continue;
+			for(int i = 0; i < n; i++)
+				diagonal[i] += views[v].at<double>(i, i);
+			nPosed++;
+		}
+		double scale[n];
+		for(int i = 0; i < n; i++)
+			scale[i] = diagonal[i] > 0 ? 1 / sqrt(diagonal[i] / nPosed) : 1;
+		information[camera].assign(nViews, vector<double>());
+		for(int v = 0; v < nViews; v++)
+		{
+			if(views[v].empty())
+				continue;
+			vector<double>& info = information[camera][v];
+			info.resize(n * n);
+			for(int i = 0; i < n; i++)
+				for(int j = 0; j < n; j++)
+					info[i * n + j] = views[v].at<double>(i, j) * scale[i] * scale[j];
+		}
+	}
+
+	// summed information of picked views starts from the prior
+	vector<double> sum[2];
+	for(int camera = 0; camera < nCameras; camera++)
+	{
+		sum[camera].assign(n * n, 0.0);
+		for(int i = 0; i < n; i++)
+			sum[camera][i * n + i] = prior;
+	}
+	auto gainOf = [&](int v, double current) -> double
+	{
+		double gain = -current;
+		for(int camera = 0; camera < nCameras; camera++)
+			gain += logDet(&sum[camera][0], &information[camera][v][0]);
+		return gain;
+	};
+	double current = 0;
+	for(int camera = 0; camera < nCameras; camera++)
+		current += logDet(&sum[camera][0], NULL);
+
+	// lazy greedy, a heap of gains with the number of picks when each gain was evaluated
+	priority_queue<pair<double, int> > heap;
+	vector<int> evaluatedAt(nViews, 0);
+	for(int v = 0; v < nViews; v++)
+	{
+		bool posed = true;
+		for(int camera = 0; camera < nCameras; camera++)
+			posed = posed && !information[camera][v].empty();
+		if(posed)
+			heap.push(make_pair(gainOf(v, current), v));
+	}
+	vector<int> selected;
+	while((int)selected.size() < nSelected && !heap.empty())
+	{
+		pair<double, int> top = heap.top();
+		heap.pop();
+		int v = top.second;
+		if(evaluatedAt[v] != (int)selected.size())
+		{
+			evaluatedAt[v] = (int)selected.size();
+			heap.push(make_pair(gainOf(v, current), v));
+			continue;
+		}
+		selected.push_back(v);
+		current += top.first;
+		for(int camera = 0; camera < nCameras; camera++)
+			for(int i = 0; i < n * n; i++)
+				sum[camera][i] += information[camera][v][i];
+	}
+
+	// D-efficiency is the geometric mean of eigenvalues of picked information to all
+	// information, its inverse square root is the typical growth of standard deviations
+	double all = 0;
+	for(int camera = 0; camera < nCameras; camera++)
+	{
+		vector<double> total(n * n, 0.0);
+		for(int i = 0; i < n; i++)
+			total[i * n + i] = prior;
+		for(int v = 0; v < nViews; v++)
+		{
+			if(information[camera][v].empty())
+				continue;
+			for(int i = 0; i < n * n; i++)
+				total[i] += information[camera][v][i];
+		}
+		all += logDet(&total[0], NULL);
+	}
+	efficiency = exp((current - all) / (n * nCameras));
+
+	sort(selected.begin(), selected.end());
+	return selected;
+}
+
+// D-efficiency of the last selection to all views, in (0, 1]
+double ViewSelector::getEfficiency()
+{
+	return efficiency;
+}
@@ -0,0 +1,36 @@
+#ifndef VIEW_SELECTOR_H_
+#define VIEW_SELECTOR_H_
+
+#include <vector>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// ViewSelector picks a small subset of views carrying most of the information about
+// intrinsics, so thousands of candidate views are solved as fast as a few dozens.
+// A pilot calibration of pilotViews evenly spaced views gives intrinsics, at which the
+// marginal information of every view is evaluated by BundleAdjuster::viewInformation().
+// Views are then picked greedily, each maximizing log det of the information summed so far
+// (D-optimal design). The summed information is the inverse covariance of intrinsics, so
+// every pick shrinks the uncertainty most: views adding new tilts and corners near image
+// borders come first, and near duplicates of picked views add little and are skipped.
+// log det is submodular, gains of a view only drop as views are picked, so gains are
+// evaluated lazily, a view is evaluated again only when its stale gain is the largest.
+class ViewSelector
+{
+	private:
+		int pilotViews;           // views of the pilot calibration
+		double prior;             // weight of the identity added to normalized information
+		int nThreads;             // threads of BundleAdjuster, 0 means all cores
+		double efficiency;        // D-efficiency of the last selection to all views
+
+	public:
+		ViewSelector(int pilotViews = 60, double prior = 1e-6, int nThreads = 0);
+		vector<int> select(const vector<vector<cv::Point3f> >& objectPoints,
+				const vector<vector<cv::Point2f> >& imagePoints1,
+				const vector<vector<cv::Point2f> >& imagePoints2,
+				cv::Size imageSize, int nSelected);
+		double getEfficiency();
+};
+
+#endif
@@ -0,0 +1,119 @@
+#include "Viewer.h"
+
+#include <algorithm>
+#include <opencv2/highgui/highgui.hpp>
+
+// Constructors
+// delay: milliseconds of waitKey() every time the viewer thread refreshes windows
+Viewer::Viewer(int delay)
+{
+	running = false;
+	this->delay = delay;
+	lastKey = -1;
+	nDropped = 0;
+}
+
+// class destructor
+// windows are closed together with the viewer thread
+Viewer::~Viewer()
+{
+	stop();
+}
+
+// methods
+// start the viewer thread, it's also started by the first show()
+void Viewer::start()
+{
+	lock_guard<mutex> lock(mtx);
+	if(running)
+		return;
+	running = true;
+	worker = thread(&Viewer::run, this);
+}
+
+// stop the viewer thread and close its windows, frames not shown yet are dropped
+void Viewer::stop()
+{
+	{
+		lock_guard<mutex> lock(mtx);
+		if(!running)
+			return;
+		running = false;
+		nDropped += (int)frames.size();
+		frames.clear();
+	}
+	cond.notify_one();
+	worker.join();
+}
+
+// show frame in window without waiting for the display
+// frame is copied, so the caller may reuse its buffer at once
+void Viewer::show(string window, cv::Mat frame)
+{
+	if(frame.empty())
+		return;
+	start();
+
+	cv::Mat copy = frame.clone();
+	{
+		lock_guard<mutex> lock(mtx);
+		cv::Mat& latest = frames[window];
+		if(!latest.empty())
+			nDropped++;
+		latest = copy;
+	}
+	cond.notify_one();
+}
+
+// take the last key pressed in any window, -1 if no key is pressed since last call
+int Viewer::getKey()
+{
+	lock_guard<mutex> lock(mtx);
+	int key = lastKey;
+	lastKey = -1;
+	return key;
+}
+
+int Viewer::getnDropped()
+{
+	lock_guard<mutex> lock(mtx);
+	return nDropped;
+}
+
+// loop of the viewer thread, only this thread calls HighGUI
+void Viewer::run()
+{
+	unique_lock<mutex> lock(mtx);
+	while(running)
+	{
+		// sleep until the first frame comes, then keep polling keys of open windows
+		if(frames.empty() && windows.empty())
+		{
+			cond.wait(lock);
+			continue;
+		}
+
+		map<string, cv::Mat> latest;
+		latest.swap(frames);
+		lock.unlock();
+
+		for(map<string, cv::Mat>::iterator it = latest.begin(); it != latest.end(); ++it)
+		{
+			if(find(windows.begin(), windows.end(), it->first) == windows.end())
+				windows.push_back(it->first);
+			cv::imshow(it->first, it->second);
+		}
+		int key = cv::waitKey(delay);
+
+		lock.lock();
+		if(key >= 0)
+			lastKey = key & 255;
+	}
+	lock.unlock();
+
+	for(size_t i = 0; i < windows.size(); i++)
+		cv::destroyWindow(windows[i]);
+	if(!windows.empty())
+		cv::waitKey(1);
+	windows.clear();
+}
@@ -0,0 +1,42 @@
+#ifndef VIEWER_H_
+#define VIEWER_H_
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core/core.hpp>
+
+using namespace std;
+
+// Viewer shows frames in HighGUI windows on its own thread.
+// Each window keeps only its latest frame, a frame not shown yet is dropped
+// when a newer one comes, so threads calling show() never wait for the display.
+class Viewer
+{
+	private:
+		map<string, cv::Mat> frames;   // latest frame not shown yet of every window
+		vector<string> windows;        // windows opened by the viewer thread
+		mutex mtx;                     // guards frames, running, lastKey and nDropped
+		condition_variable cond;       // wakes the viewer thread up when frames come
+		thread worker;                 // viewer thread owning all windows
+		bool running;                  // whether the viewer thread is running
+		int delay;                     // milliseconds of waitKey() on the viewer thread
+		int lastKey;                   // last pressed key not taken yet, -1 if none
+		int nDropped;                  // number of frames dropped without being shown
+
+		void run();
+
+	public:
+		Viewer(int delay = 10);
+		~Viewer();
+		void start();
+		void stop();
+		void show(string window, cv::Mat frame);
+		int getKey();
+		int getnDropped();
+};
+
+#endif
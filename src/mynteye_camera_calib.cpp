@@ -4,11 +4,15 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <string>
+#include <cstdlib>
 
 #include "camera.h"
 #include "utility.h"
 
 #include "Calibrator.h"
+#include "Viewer.h"
+#include "CornerTracker.h"
+#include "AutoCapture.h"
 
 using namespace std;
 using namespace mynteye;
@@ -24,6 +28,139 @@ int main(int argc, char const *argv[])
 	// It helps to create string* variables for saved images.
 	calib.setImageNames();
 
+	// Command line options:
+	// --headless   calibrate images saved in ./mynteye_images/ before, without any window
+	// --preview    show detected chessboards without waiting one second for each
+	// --threads N  detect corners with N threads, all cores by default
+	// --prefetch N read N images ahead of detecting, twice the threads by default
+	// --no-save    calibrate with captured images in memory without saving them
+	// --cache      with --headless, reuse corners cached in ./mynteye_images/corners_cache.yml
+	// --pyramid W  find chessboards on a pyramid level no wider than W, then refine on full images
+	// --fast-reject  reject frames without a chessboard by a cheap check before the full detection
+	// --saddle     find chessboards by the saddle point detector instead of findChessboardCorners()
+	// --fast-subpix  refine corners by the vectorized kernel instead of cornerSubPix()
+	// --sparse     solve intrinsics by the sparse bundle adjuster instead of calibrateCamera()
+	// --joint-stereo  calibrate both cameras and R, T of the DCM in one optimization
+	// --select K   solve only K collected views carrying most information about intrinsics
+	// --reject-outliers S  drop views S robust standard deviations above the median error and solve again
+	// --cross-validate K  after calibrating, solve K folds of views concurrently and report held-out errors
+	// --auto       capture sharp frames adding new poses or coverage automatically, besides SPACE
+	// --coverage   overlay covered image cells and board tilts, stop capturing once they are enough
+	// --early-stop  estimate parameter uncertainty while capturing, stop once it's low enough
+	// --track      overlay chessboards on live frames, tracking corners by optical flow between frames
+	// --benchmark  compare configured detection with reference detection on saved images,
+	//              with --replay F compare the sparse bundle adjuster with calibrateCamera() instead
+	// --export F   save collected corners into binary file F after calibrating
+	// --replay F   calibrate with corners in binary file F only, no camera or image is needed
+	bool headless = false;
+	bool saveImages = true;
+	bool benchmark = false;
+	bool track = false;
+	bool autoMode = false;
+	bool showCoverage = false;
+	bool earlyStop = false;
+	string exportFile, replayFile;
+	for(int i = 1; i < argc; i++)
+	{
+		string arg = argv[i];
+		if(arg == "--headless")
+		{
+			headless = true;
+			calib.setDisplayMode(DISPLAY_NONE);
+		}
+		else if(arg == "--preview")
+			calib.setDisplayMode(DISPLAY_PREVIEW);
+		else if(arg == "--threads" && i + 1 < argc)
+			calib.setNumThreads(atoi(argv[++i]));
+		else if(arg == "--prefetch" && i + 1 < argc)
+			calib.setPrefetchDepth(atoi(argv[++i]));
+		else if(arg == "--no-save")
+			saveImages = false;
+		else if(arg == "--cache")
+			calib.setCornerCache(true);
+		else if(arg == "--pyramid" && i + 1 < argc)
+			calib.setPyramidWidth(atoi(argv[++i]));
+		else if(arg == "--fast-reject")
+			calib.setFastReject(true);
+		else if(arg == "--saddle")
+			calib.setDetector(DETECTOR_SADDLE);
+		else if(arg == "--fast-subpix")
+			calib.setRefiner(SUBPIX_KERNEL);
+		else if(arg == "--sparse")
+			calib.setSolver(SOLVER_SPARSE);
+		else if(arg == "--joint-stereo")
+			calib.setStereoMode(STEREO_JOINT);
+		else if(arg == "--select" && i + 1 < argc)
+			calib.setViewSelection(atoi(argv[++i]));
+		else if(arg == "--reject-outliers" && i + 1 < argc)
+			calib.setOutlierRejection(atof(argv[++i]));
+		else if(arg == "--cross-validate" && i + 1 < argc)
+			calib.setCrossValidation(atoi(argv[++i]));
+		else if(arg == "--auto")
+			autoMode = true;
+		else if(arg == "--early-stop")
+			earlyStop = true;
+		else if(arg == "--coverage")
+			showCoverage = true;
+		else if(arg == "--track")
+			track = true;
+		else if(arg == "--benchmark")
+			benchmark = true;
+		else if(arg == "--export" && i + 1 < argc)
+			exportFile = argv[++i];
+		else if(arg == "--replay" && i + 1 < argc)
+			replayFile = argv[++i];
+		else
+		{
+			cerr << "\033[0;32mUsage: \033[0m" << argv[0]
+				<< " [--headless] [--preview] [--threads N] [--prefetch N] [--no-save] [--cache]"
+				<< " [--pyramid W] [--fast-reject] [--saddle] [--fast-subpix] [--sparse] [--joint-stereo]"
+				<< " [--select K] [--reject-outliers S] [--cross-validate K]"
+				<< " [--auto] [--coverage] [--early-stop] [--track] [--benchmark]"
+				<< " [--export FILE] [--replay FILE]" << endl;
+			exit(0);
+		}
+	}
+
+	// Images are calibrated at the native resolution of the camera, and parameters are
+	// scaled to the image size of the Calibrator afterwards, so frames are never resized.
+	cv::Size targetSize = calib.getImageSize();
+
+	if(benchmark)
+	{
+		if(!replayFile.empty())
+		{
+			if(!calib.loadCorners(replayFile))
+				exit(0);
+			calib.benchmarkSolver();
+		}
+		else
+			calib.benchmarkDetection("./mynteye_images/");
+		return 0;
+	}
+
+	if(!replayFile.empty())
+	{
+		if(!calib.loadCorners(replayFile))
+			exit(0);
+		double avgError = calib.calibrate();
+		avgError *= calib.scaleCameraParas(targetSize);
+		calib.saveCameraParas(avgError);
+		calib.printCameraParas();
+		return 0;
+	}
+
+	if(headless)
+	{
+		double avgError = calib.calcCameraParas("./mynteye_images/");
+		if(!exportFile.empty())
+			calib.saveCorners(exportFile);
+		avgError *= calib.scaleCameraParas(targetSize);
+		calib.saveCameraParas(avgError);
+		calib.printCameraParas();
+		return 0;
+	}
+
 	// Class Camera is from mynteye packages
 	Camera cam;
 	InitParameters params("0"); // modifiable the serial number by your own camera
@@ -36,13 +173,44 @@ int main(int argc, char const *argv[])
 
 	cout << "\033[0;32mPress ESC to quit.\n"
 		<< "Press SPACE to save images and calibrate then.\033[0m\n\n";
+	if(autoMode)
+		cout << "\033[0;32mMove the chessboard slowly through different poses, "
+			<< "frames adding information are captured automatically.\033[0m\n\n";
 	
 	// n_boards is the same to your parameter for created Calibrator object.
 	// And you can get it use function getnBoards() in Class Calibrator, imageSize too.
 	int n_boards = calib.getnBoards();
-	cv::Size imageSize = calib.getImageSize();
 
-	char keyCode;
+	// Frames keep the native resolution of the camera, only a camera reporting no resolution
+	// gets its frames resized to the image size of the Calibrator.
+	Resolution resolution = cam.GetResolution();
+	cv::Size imageSize = targetSize;
+	if(resolution.width > 0 && resolution.height > 0)
+	{
+		imageSize = cv::Size(resolution.width, resolution.height);
+		calib.setImageSize(imageSize);
+	}
+	cout << "\033[0;32mCalibrate at image size \033[0m"
+		<< imageSize.width << "x" << imageSize.height << "\n" << endl;
+
+	// Live images are shown by a Viewer thread, so grabbing never waits for the display.
+	Viewer viewer;
+
+	// With --track, chessboards are drawn on live frames. Corners found by a full detection
+	// are tracked by optical flow on following frames, and the chessboard is detected again
+	// only when tracking is lost, so the overlay keeps up with the frame rate. While no chessboard
+	// is found, detection is retried every detectInterval frames only, so frames without a
+	// chessboard do not run a full detection for each camera on the grab thread.
+	CornerTracker trackers[2] = {CornerTracker(calib.getBoardSize()), CornerTracker(calib.getBoardSize())};
+	int nTrackedFrames = 0, nDetectedFrames = 0;
+	const int detectInterval = 5;
+	int framesToDetect[2] = {0, 0};
+
+	// With --auto, every frame is scored on a worker thread, which keeps the latest frame only,
+	// and accepted frames are collected here with the corners the worker found.
+	AutoCapture autoCapture(calib);
+	int sequence = 0;
+	int keyCode;
 	int frameNumber = 0;
 	ErrorCode code;
 	cv::Mat image1, image2;
@@ -53,13 +221,95 @@ int main(int argc, char const *argv[])
 		if(cam.RetrieveImage(image1, View::VIEW_LEFT_UNRECTIFIED) == ErrorCode::SUCCESS &&
 				cam.RetrieveImage(image2, View::VIEW_RIGHT_UNRECTIFIED) == ErrorCode::SUCCESS)
 		{
-			// Resize your images according to your preference
-			resize(image1, image1, imageSize, 1.0, 1.0, cv::INTER_LINEAR);
-			resize(image2, image2, imageSize, 1.0, 1.0, cv::INTER_LINEAR);
-			cv::imshow("camera1", image1);
-			cv::imshow("camera2", image2);
+			// Frames are converted to gray at once, so detecting, showing and saving
+			// handle one channel instead of three.
+			if(image1.channels() != 1)
+				cv::cvtColor(image1, image1, CV_RGB2GRAY);
+			if(image2.channels() != 1)
+				cv::cvtColor(image2, image2, CV_RGB2GRAY);
+
+			if(image1.size() != imageSize)
+				resize(image1, image1, imageSize, 1.0, 1.0, cv::INTER_LINEAR);
+			if(image2.size() != imageSize)
+				resize(image2, image2, imageSize, 1.0, 1.0, cv::INTER_LINEAR);
+			if(track || showCoverage)
+			{
+				cv::Mat frames[2] = {image1, image2};
+				const char* windows[2] = {"camera1", "camera2"};
+				for(int c = 0; c < 2; c++)
+				{
+					// overlays are drawn in color on a copy of the gray frame
+					cv::Mat view;
+					cv::cvtColor(frames[c], view, CV_GRAY2BGR);
+					if(showCoverage)
+						calib.getCoverage().draw(view, c);
+
+					if(track)
+					{
+						vector<cv::Point2f> corners;
+						bool found = trackers[c].track(frames[c], corners);
+						if(found)
+							nTrackedFrames++;
+						else if(framesToDetect[c] > 0)
+							framesToDetect[c]--;
+						else
+						{
+							found = calib.findBoard(frames[c], corners);
+							trackers[c].reset(frames[c], found ? corners : vector<cv::Point2f>());
+							framesToDetect[c] = found ? 0 : detectInterval - 1;
+							nDetectedFrames++;
+						}
+						cv::drawChessboardCorners(view, calib.getBoardSize(), corners, found);
+					}
+					viewer.show(windows[c], view);
+				}
+			}
+			else
+			{
+				viewer.show("camera1", image1);
+				viewer.show("camera2", image2);
+			}
+
+			if(autoMode)
+			{
+				autoCapture.push(sequence++, image1, image2);
+				CapturedView captured;
+				while(frameNumber < n_boards && autoCapture.pop(captured))
+				{
+					cout << "\033[0;32mAuto captured, blur: \033[0m" << captured.blur << " px"
+						<< "\033[0;32m, pose novelty: \033[0m" << captured.novelty
+						<< "\033[0;32m, new cells: \033[0m" << captured.newCells << endl;
+					if(!calib.addCorners(captured.corners1, captured.corners2))
+						continue;
+					if(saveImages)
+						calib.saveImages(frameNumber, "./mynteye_images/", captured.frame1, captured.frame2);
+					frameNumber++;
+				}
+			}
 			
-			keyCode = cv::waitKey(10);
+			// With --early-stop, parameters are estimated again on a worker thread after new views,
+			// and capturing ends once their standard deviations are below the targets.
+			if(earlyStop)
+			{
+				calib.updateUncertainty();
+				if(calib.isConverged())
+				{
+					cout << "\033[0;32mParameters converged with \033[0m" << frameNumber
+						<< "\033[0;32m frames.\033[0m\n" << endl;
+					break;
+				}
+			}
+
+			// With --coverage, capturing ends as soon as corners cover enough of both images
+			// with enough different tilts, even if fewer than n_boards frames are captured.
+			if(showCoverage && calib.getCoverage().isComplete())
+			{
+				cout << "\033[0;32mCoverage targets are met with \033[0m" << frameNumber
+					<< "\033[0;32m frames.\033[0m\n" << endl;
+				break;
+			}
+
+			keyCode = viewer.getKey();
 			if(keyCode == 27)
 			{
 				cout << "\033[0;32mQuit calibrating.\033[0m\n" << endl;
@@ -67,15 +317,40 @@ int main(int argc, char const *argv[])
 			}
 			if(keyCode == 32)
 			{
-				calib.saveImages(frameNumber, "./mynteye_images/", image1, image2);
+				// Corners are detected at once, and frames without a whole chessboard are dropped.
+				if(!calib.addFrame(image1, image2))
+				{
+					cout << "\033[0;32mChessboard is not found, please capture again.\033[0m\n" << endl;
+					continue;
+				}
+				if(saveImages)
+					calib.saveImages(frameNumber, "./mynteye_images/", image1, image2);
 				frameNumber++;
 			}
 			else 
 				continue;
 		}
 	}
+	viewer.stop();
+	if(autoMode)
+	{
+		autoCapture.stop();
+		cout << "\033[0;32mscored frames: \033[0m" << autoCapture.getnScored()
+			<< "\033[0;32m, frames dropped while scoring: \033[0m" << autoCapture.getnDropped() << endl;
+	}
+	if(track)
+	{
+		cout << "\033[0;32mtracked frames: \033[0m" << nTrackedFrames
+			<< "\033[0;32m, fully detected frames: \033[0m" << nDetectedFrames << endl;
+	}
+	if(saveImages)
+		calib.waitSavedImages();
 
-	double avgError = calib.calcCameraParas("./mynteye_images/");
+	// Calibrate with corners collected by addFrame(), images are not read back from disk.
+	double avgError = calib.calibrate();
+	if(!exportFile.empty())
+		calib.saveCorners(exportFile);
+	avgError *= calib.scaleCameraParas(targetSize);
 	calib.saveCameraParas(avgError);
 	calib.printCameraParas();
 